@@ -1,3 +1,4 @@
 #!/bin/bash
  
-clang-format -i usb-ps1-mouse/*.c usb-ps1-mouse/*.h
+# headers generated by pioasm are left as they come
+clang-format -i usb-ps1-mouse/*.c $(ls usb-ps1-mouse/*.h | grep -v '\.pio\.h$')
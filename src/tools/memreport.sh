@@ -0,0 +1,53 @@
+#!/bin/sh
+# What of the firmware lives in SRAM and what in flash, from its symbols.
+# Runs after every link, see usb-ps1-mouse/CMakeLists.txt and sram.h.
+#
+# Usage: memreport.sh nm firmware.elf [table_min_bytes]
+
+NM=${1:?nm}
+ELF=${2:?elf}
+MIN=${3:-64}
+
+"$NM" -S -n --defined-only "$ELF" | awk -v min="$MIN" '
+function hex(s, i, v) {
+  v = 0
+  for (i = 1; i <= length(s); ++i) {
+    v = v * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+  }
+  return v
+}
+NF == 4 {
+  addr = $1
+  size = hex($2)
+  type = tolower($3)
+  name = $4
+  if (size == 0) {
+    next
+  }
+  region = addr ~ /^1/ ? "flash" : addr ~ /^2/ ? "sram" : ""
+  if (region == "") {
+    next
+  }
+  kind = type == "t" || type == "w" ? "code" : "data"
+  total[region, kind] += size
+  if (region == "sram" && kind == "code") {
+    ramCode[++ramCodes] = sprintf("  %s %6d %s", addr, size, name)
+  } else if (kind == "data" && size >= min) {
+    tables[++tableCount] = sprintf("  %-5s %s %6d %s", region, addr, size, name)
+  }
+}
+END {
+  printf "memory by symbol, bytes:  %8s %8s\n", "code", "data"
+  printf "  flash                   %8d %8d\n", total["flash", "code"], \
+         total["flash", "data"]
+  printf "  sram                    %8d %8d\n", total["sram", "code"], \
+         total["sram", "data"]
+  print "code in sram:"
+  for (i = 1; i <= ramCodes; ++i) {
+    print ramCode[i]
+  }
+  print "tables and buffers of " min " bytes and more:"
+  for (i = 1; i <= tableCount; ++i) {
+    print tables[i]
+  }
+}'
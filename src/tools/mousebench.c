@@ -0,0 +1,397 @@
+// Host timing of the mouse report parser (parsemouse.c) on corpus entries:
+// what compiling a descriptor at mount takes, and decoding one report, next
+// to the decoder the field plans replaced.
+//
+// Build: the mousebench target of CMakeLists.txt here; the bench target runs
+//        it on test/corpus
+// Usage: mousebench [-c] input... > bench.jsonl
+//
+// Inputs are in the format of mousefuzz.c. A JSON line per input gives
+// descr_ns and report_ns, the host time of one call, and old_report_ns for
+// the old decoder on the same reports, "excluded" if the descriptor is beyond
+// it. The last line is the mean over all inputs for descr_ns, and over the
+// compared ones for the report times; excluded counts the others. The RP2040
+// takes a multiple of these, see the -s factor of psxsim.
+// Both decoders must agree on every report, or mousebench fails; -c only
+// checks that, without timing.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parsemouse.h"
+
+#define MAX_INPUT 0x10000
+#define MAX_REPORTS 1024
+#define BENCH_NS 100000000ull // per input and measurement
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+typedef struct {
+  uint32_t descrLen;
+  const uint8_t *descr;
+  uint32_t reports;
+  uint8_t reportLen[MAX_REPORTS];
+  const uint8_t *report[MAX_REPORTS];
+} Input;
+
+static void inputSplit(const uint8_t *data, size_t size, Input *in) {
+  in->descrLen = size < 2 ? 0 : data[0] | data[1] << 8;
+  if (in->descrLen > size - 2) {
+    in->descrLen = size - 2;
+  }
+  in->descr = data + 2;
+  in->reports = 0;
+  for (size_t i = 2 + in->descrLen; i < size && in->reports != MAX_REPORTS;) {
+    uint32_t len = data[i++];
+    if (len > size - i) {
+      len = size - i;
+    }
+    in->reportLen[in->reports] = len;
+    in->report[in->reports++] = data + i;
+    i += len;
+  }
+}
+
+// The decoder before the field plans: a bit offset and size per field,
+// extractBits() with a switch on the size, values clamped to 8 bits.
+typedef struct {
+  uint8_t isId;
+  uint8_t id;
+  uint8_t btnI;
+  uint8_t xI;
+  uint8_t xSize;
+  uint8_t yI;
+  uint8_t ySize;
+  uint8_t wheelI;
+  uint8_t wheelSize;
+} OldConf;
+
+static int16_t extractBits(const uint8_t *data, uint32_t dataLen, uint8_t aI,
+                           uint8_t aSize) {
+  uint32_t ret32 = 0;
+  uint8_t bI = aI >> 3;
+  uint8_t mI = aI & 7;
+  for (uint32_t i = 0; i != 3; ++i) {
+    if (i + bI < dataLen) {
+      ret32 |= ((uint32_t)data[i + bI]) << (i * 8);
+    }
+  }
+  ret32 = ret32 >> mI;
+  uint16_t ret16 = (uint16_t)ret32;
+
+  switch (aSize) {
+  case 0:
+    ret16 = 0;
+    break;
+  case 1:
+    ret16 &= 1;
+    if (ret16 & 1) {
+      ret16 |= 65534;
+    }
+    break;
+  case 2:
+    ret16 &= 3;
+    if (ret16 & 2) {
+      ret16 |= 65532;
+    }
+    break;
+  case 3:
+    ret16 &= 7;
+    if (ret16 & 4) {
+      ret16 |= 65528;
+    }
+    break;
+  case 4:
+    ret16 &= 15;
+    if (ret16 & 8) {
+      ret16 |= 65520;
+    }
+    break;
+  case 5:
+    ret16 &= 31;
+    if (ret16 & 16) {
+      ret16 |= 65504;
+    }
+    break;
+  case 6:
+    ret16 &= 63;
+    if (ret16 & 32) {
+      ret16 |= 65472;
+    }
+    break;
+  case 7:
+    ret16 &= 127;
+    if (ret16 & 64) {
+      ret16 |= 65408;
+    }
+    break;
+  case 8:
+    ret16 &= 255;
+    if (ret16 & 128) {
+      ret16 |= 65280;
+    }
+    break;
+  case 9:
+    ret16 &= 511;
+    if (ret16 & 256) {
+      ret16 |= 65024;
+    }
+    break;
+  case 10:
+    ret16 &= 1023;
+    if (ret16 & 512) {
+      ret16 |= 64512;
+    }
+    break;
+  case 11:
+    ret16 &= 2047;
+    if (ret16 & 1024) {
+      ret16 |= 63488;
+    }
+    break;
+  case 12:
+    ret16 &= 4095;
+    if (ret16 & 2048) {
+      ret16 |= 61440;
+    }
+    break;
+  case 13:
+    ret16 &= 8191;
+    if (ret16 & 4096) {
+      ret16 |= 57344;
+    }
+    break;
+  case 14:
+    ret16 &= 16383;
+    if (ret16 & 8192) {
+      ret16 |= 49152;
+    }
+    break;
+  case 15:
+    ret16 &= 32767;
+    if (ret16 & 16384) {
+      ret16 |= 32768;
+    }
+    break;
+  default:
+    break;
+  }
+
+  return (int16_t)ret16;
+}
+
+static int oldParseMouseData(const uint8_t *data, uint32_t dataLen,
+                             const OldConf *conf, int8_t o[4]) {
+  const int ok = 0;
+  const int err = 1;
+  o[0] = o[1] = o[2] = o[3] = 0;
+  if (conf->isId && dataLen > 0 && conf->id != data[0]) {
+    return err;
+  }
+  o[0] = (int8_t)extractBits(data, dataLen, conf->btnI, 8);
+  for (uint32_t i = 0; i != 3; ++i) {
+    uint8_t aI = 0;
+    uint8_t aSize = 0;
+    switch (i) {
+    case 0:
+      aI = conf->xI;
+      aSize = conf->xSize;
+      break;
+    case 1:
+      aI = conf->yI;
+      aSize = conf->ySize;
+      break;
+    case 2:
+      aI = conf->wheelI;
+      aSize = conf->wheelSize;
+      break;
+    }
+    int16_t a = extractBits(data, dataLen, aI, aSize);
+    if (a < -128) {
+      a = 128;
+    } else if (a > 127) {
+      a = 127;
+    }
+    o[i + 1] = (int8_t)a;
+  }
+  return ok;
+}
+
+// bit offset and size of a planned field; 0 bits if it is not there
+static void oldField(const MouseField *f, uint8_t *at, uint8_t *size) {
+  uint32_t bits = 0, shift = 0;
+  if (f->kind == FIELD_S8 || f->kind == FIELD_S16) {
+    bits = f->kind * 8;
+  } else if (f->kind == FIELD_BITS) {
+    bits = 32 - f->rsh;
+    shift = 32 - f->lsh - bits;
+  }
+  *at = f->byte * 8 + shift;
+  *size = bits;
+}
+
+// The old parser kept one report, the first; its offsets were 8 bits wide.
+// Returns non-zero if conf is beyond it.
+static int oldConf(const MouseConf *conf, OldConf *old) {
+  MousePlan plan;
+  mousePlanPack(conf, &plan);
+  const MouseReport *r = plan.reports;
+  if (conf->count != 1 || r->dataLen > 32) {
+    return -1;
+  }
+  old->isId = plan.hasIds;
+  old->id = plan.ids[0];
+  uint8_t btnSize; // the old decoder read 8 bits there
+  oldField(&r->btn, &old->btnI, &btnSize);
+  oldField(&r->x, &old->xI, &old->xSize);
+  oldField(&r->y, &old->yI, &old->ySize);
+  oldField(&r->wheel, &old->wheelI, &old->wheelSize);
+  return 0;
+}
+
+static int8_t clamp8(int16_t v) { return v < -128 ? -128 : v > 127 ? 127 : v; }
+
+// the decoders agree on every mouse report of in
+static int sameOutput(const char *name, const Input *in, const MouseConf *conf,
+                      const OldConf *old) {
+  for (uint32_t i = 0; i != in->reports; ++i) {
+    int16_t o[4];
+    int8_t p[4];
+    if (parseMouseData(in->report[i], in->reportLen[i], conf, o) != 0) {
+      continue;
+    }
+    // the old decoder read all 8 bits at the buttons
+    uint8_t at, btnSize;
+    oldField(&conf->reports[0].btn, &at, &btnSize);
+    const uint8_t btnMask = (1u << btnSize) - 1;
+    if (oldParseMouseData(in->report[i], in->reportLen[i], old, p) != 0 ||
+        ((o[0] ^ p[0]) & btnMask) || clamp8(o[1]) != p[1] ||
+        clamp8(o[2]) != p[2] || clamp8(o[3]) != p[3]) {
+      fprintf(stderr, "mousebench: %s: report %u decodes differently\n", name,
+              i);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// keeps the compiler from dropping the calls
+static volatile int32_t gSink;
+
+static double benchDescr(const Input *in, MouseConf *conf) {
+  uint64_t calls = 0;
+  const uint64_t start = nowNs();
+  uint64_t ns;
+  do {
+    for (uint32_t i = 0; i != 100; ++i) {
+      parseMouseDescr(in->descr, in->descrLen, conf);
+    }
+    calls += 100;
+    gSink += conf->count;
+    ns = nowNs() - start;
+  } while (ns < BENCH_NS);
+  return (double)ns / calls;
+}
+
+static double benchReports(const Input *in, const MouseConf *conf) {
+  if (in->reports == 0) {
+    return 0;
+  }
+  uint64_t calls = 0;
+  const uint64_t start = nowNs();
+  uint64_t ns;
+  do {
+    for (uint32_t i = 0; i != in->reports; ++i) {
+      int16_t o[4];
+      parseMouseData(in->report[i], in->reportLen[i], conf, o);
+      gSink += o[1] + o[2];
+    }
+    calls += in->reports;
+    ns = nowNs() - start;
+  } while (ns < BENCH_NS);
+  return (double)ns / calls;
+}
+
+static double benchOldReports(const Input *in, const OldConf *old) {
+  if (in->reports == 0) {
+    return 0;
+  }
+  uint64_t calls = 0;
+  const uint64_t start = nowNs();
+  uint64_t ns;
+  do {
+    for (uint32_t i = 0; i != in->reports; ++i) {
+      int8_t o[4];
+      oldParseMouseData(in->report[i], in->reportLen[i], old, o);
+      gSink += o[1] + o[2];
+    }
+    calls += in->reports;
+    ns = nowNs() - start;
+  } while (ns < BENCH_NS);
+  return (double)ns / calls;
+}
+
+int main(int argc, char **argv) {
+  static uint8_t data[MAX_INPUT];
+  static Input in;
+  static MouseConf conf;
+  OldConf old;
+  int i = 1;
+  const int check = i < argc && strcmp(argv[i], "-c") == 0;
+  i += check;
+  const int inputs = argc - i;
+  double descrSum = 0, reportSum = 0, oldSum = 0;
+  int reportInputs = 0;
+  for (; i < argc; ++i) {
+    FILE *f = fopen(argv[i], "rb");
+    if (!f) {
+      perror(argv[i]);
+      return 1;
+    }
+    const size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    inputSplit(data, size, &in);
+    parseMouseDescr(in.descr, in.descrLen, &conf);
+    const int hasOld = oldConf(&conf, &old) == 0;
+    if (hasOld && !sameOutput(argv[i], &in, &conf, &old)) {
+      return 1;
+    }
+    if (check) {
+      continue;
+    }
+    const double descrNs = benchDescr(&in, &conf);
+    const double reportNs = benchReports(&in, &conf);
+    const double oldNs = hasOld ? benchOldReports(&in, &old) : 0;
+    char oldText[16] = "excluded";
+    if (hasOld) {
+      snprintf(oldText, sizeof(oldText), "%.1f", oldNs);
+    }
+    printf("{\"event\":\"bench\",\"input\":\"%s\",\"descr_ns\":\"%.0f\","
+           "\"reports\":\"%u\",\"report_ns\":\"%.1f\","
+           "\"old_report_ns\":\"%s\"}\n",
+           argv[i], descrNs, in.reports, reportNs, oldText);
+    descrSum += descrNs;
+    if (in.reports && hasOld) {
+      reportSum += reportNs;
+      oldSum += oldNs;
+      ++reportInputs;
+    }
+  }
+  if (!check && inputs > 0) {
+    // report means over the inputs both decoders handle
+    printf("{\"event\":\"bench_mean\",\"inputs\":\"%d\",\"excluded\":"
+           "\"%d\",\"descr_ns\":\"%.0f\",\"report_ns\":\"%.1f\","
+           "\"old_report_ns\":\"%.1f\"}\n",
+           inputs, inputs - reportInputs, descrSum / inputs,
+           reportInputs ? reportSum / reportInputs : 0.0,
+           reportInputs ? oldSum / reportInputs : 0.0);
+  }
+  return 0;
+}
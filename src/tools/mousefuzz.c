@@ -0,0 +1,246 @@
+// Fuzz target of the mouse report parser (parsemouse.c): a descriptor is
+// compiled, its plan packed and unpacked as for the device cache, and the
+// reports decoded with it.
+//
+// Build: the mousefuzz target of CMakeLists.txt here. With clang and
+//        -DFUZZ=ON it is a libFuzzer binary; otherwise main() below runs
+//        the inputs it is given, which is also how AFL calls it (@@).
+// Usage: mousefuzz [-v] input...     run inputs, stdin without any; -v
+//                                      prints the plans and decoded reports
+//        mousefuzz -w dir < log.jsonl  write a corpus entry per mount
+//
+// An input is the length of the descriptor (2 bytes, little endian), the
+// descriptor, then the reports, each after a byte with its length. -w takes
+// the mount and report events of a psxtrace log (DEBUG_TRACE); an entry holds
+// a mount's descriptor and the reports of its interface until the unmount.
+// The corpus in test/corpus was made from test/mice.jsonl this way.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parsemouse.h"
+
+#define MAX_INPUT 0x10000
+
+static int gVerbose;
+
+static void printField(const char *name, const MouseField *f) {
+  static const char *const kinds[] = {"none", "s8", "s16", "bits"};
+  printf(" %s %s", name, f->kind <= FIELD_BITS ? kinds[f->kind] : "?");
+  if (f->kind == FIELD_BITS) {
+    printf("@%u+%u<<%u>>%u", f->byte, f->len, f->lsh, f->rsh);
+  } else if (f->kind != FIELD_NONE) {
+    printf("@%u", f->byte);
+  }
+}
+
+static void printPlan(const MousePlan *plan) {
+  for (uint32_t r = 0; r != plan->count; ++r) {
+    const MouseReport *rep = plan->reports + r;
+    printf("  plan id %u:", plan->ids[r]);
+    printField("btn", &rep->btn);
+    printField("x", &rep->x);
+    printField("y", &rep->y);
+    printField("wheel", &rep->wheel);
+    printf(", %u bytes\n", rep->dataLen);
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < 2) {
+    return 0;
+  }
+  uint32_t descrLen = data[0] | data[1] << 8;
+  if (descrLen > size - 2) {
+    descrLen = size - 2;
+  }
+  static MouseConf conf;
+  parseMouseDescr(data + 2, descrLen, &conf);
+
+  // what the device cache keeps must come back as it was
+  static MousePlan plan;
+  static MouseConf unpacked;
+  mousePlanPack(&conf, &plan);
+  if (conf.count && (mousePlanUnpack(&plan, &unpacked) != 0 ||
+                     memcmp(&conf, &unpacked, sizeof(conf)) != 0)) {
+    abort();
+  }
+  if (gVerbose) {
+    printf("descriptor %u bytes, %u mouse reports%s\n", descrLen, conf.count,
+           conf.hasIds ? " by ID" : "");
+    printPlan(&plan);
+  }
+
+  for (size_t i = 2 + descrLen; i < size;) {
+    uint32_t len = data[i++];
+    if (len > size - i) {
+      len = size - i;
+    }
+    // a copy of exactly len bytes, so reads past it are caught
+    uint8_t *report = malloc(len ? len : 1);
+    memcpy(report, data + i, len);
+    int16_t o[4];
+    const int err = parseMouseData(report, len, &conf, o);
+    free(report);
+    if (gVerbose) {
+      if (err) {
+        printf("  report %u bytes: not a mouse report\n", len);
+      } else {
+        printf("  report %u bytes: buttons %02x x %d y %d wheel %d\n", len,
+               (uint16_t)o[0] & 0xff, o[1], o[2], o[3]);
+      }
+    }
+    i += len;
+  }
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+// value of "name":"..." in a JSON line, empty if there is none
+static void jsonField(const char *line, const char *name, char *buf,
+                      size_t size) {
+  char key[32];
+  snprintf(key, sizeof(key), "\"%s\":\"", name);
+  const char *p = strstr(line, key);
+  buf[0] = 0;
+  if (!p) {
+    return;
+  }
+  p += strlen(key);
+  size_t n = 0;
+  while (p[n] && p[n] != '"' && n + 1 < size) {
+    ++n;
+  }
+  memcpy(buf, p, n);
+  buf[n] = 0;
+}
+
+static uint32_t hexBytes(const char *s, uint8_t *out, uint32_t max) {
+  uint32_t n = 0;
+  for (char *end; n != max; s = end) {
+    const unsigned long b = strtoul(s, &end, 16);
+    if (end == s) {
+      break;
+    }
+    out[n++] = b;
+  }
+  return n;
+}
+
+typedef struct {
+  FILE *f;
+  char addr[8];
+  char instance[8];
+} CorpusEntry;
+
+#define CORPUS_OPEN 16
+
+static int corpusWrite(const char *dir) {
+  static char line[0x30000];
+  static char value[sizeof(line)];
+  static uint8_t bytes[MAX_INPUT];
+  CorpusEntry open[CORPUS_OPEN] = {0};
+  char addr[8], instance[8];
+  int written = 0;
+  while (fgets(line, sizeof(line), stdin)) {
+    jsonField(line, "event", value, sizeof(value));
+    jsonField(line, "address", addr, sizeof(addr));
+    jsonField(line, "instance", instance, sizeof(instance));
+    CorpusEntry *e = NULL;
+    for (uint32_t i = 0; i != CORPUS_OPEN; ++i) {
+      if (open[i].f && strcmp(open[i].addr, addr) == 0 &&
+          strcmp(open[i].instance, instance) == 0) {
+        e = open + i;
+      }
+    }
+    if (strcmp(value, "mount") == 0) {
+      if (e) {
+        fclose(e->f);
+        e->f = NULL;
+      }
+      for (uint32_t i = 0; !e && i != CORPUS_OPEN; ++i) {
+        e = open[i].f ? NULL : open + i;
+      }
+      if (!e) {
+        fprintf(stderr, "mousefuzz: too many interfaces at once\n");
+        return 1;
+      }
+      char vid[8], pid[8], path[512];
+      jsonField(line, "vid", vid, sizeof(vid));
+      jsonField(line, "pid", pid, sizeof(pid));
+      snprintf(path, sizeof(path), "%s/%s_%s_%s", dir, vid, pid, instance);
+      e->f = fopen(path, "wb");
+      if (!e->f) {
+        perror(path);
+        return 1;
+      }
+      strcpy(e->addr, addr);
+      strcpy(e->instance, instance);
+      jsonField(line, "data", value, sizeof(value));
+      const uint32_t n = hexBytes(value, bytes, 0xffff);
+      fputc(n & 0xff, e->f);
+      fputc(n >> 8, e->f);
+      fwrite(bytes, 1, n, e->f);
+      ++written;
+    } else if (strcmp(value, "report") == 0 && e) {
+      jsonField(line, "data", value, sizeof(value));
+      const uint32_t n = hexBytes(value, bytes, 0xff);
+      fputc(n, e->f);
+      fwrite(bytes, 1, n, e->f);
+    } else if (strcmp(value, "umount") == 0 && e) {
+      fclose(e->f);
+      e->f = NULL;
+    }
+  }
+  for (uint32_t i = 0; i != CORPUS_OPEN; ++i) {
+    if (open[i].f) {
+      fclose(open[i].f);
+    }
+  }
+  fprintf(stderr, "mousefuzz: %d corpus entries in %s\n", written, dir);
+  return 0;
+}
+
+static int runFile(FILE *f, const char *name) {
+  static uint8_t data[MAX_INPUT];
+  const size_t size = fread(data, 1, sizeof(data), f);
+  if (ferror(f)) {
+    perror(name);
+    return 1;
+  }
+  if (gVerbose) {
+    const char *base = strrchr(name, '/');
+    printf("%s\n", base ? base + 1 : name);
+  }
+  return LLVMFuzzerTestOneInput(data, size);
+}
+
+int main(int argc, char **argv) {
+  int i = 1;
+  if (argc == 3 && strcmp(argv[1], "-w") == 0) {
+    return corpusWrite(argv[2]);
+  }
+  if (i < argc && strcmp(argv[i], "-v") == 0) {
+    gVerbose = 1;
+    ++i;
+  }
+  if (i == argc) {
+    return runFile(stdin, "stdin");
+  }
+  for (; i < argc; ++i) {
+    FILE *f = fopen(argv[i], "rb");
+    if (!f) {
+      perror(argv[i]);
+      return 1;
+    }
+    const int err = runFile(f, argv[i]);
+    fclose(f);
+    if (err) {
+      return err;
+    }
+  }
+  return 0;
+}
+#endif
@@ -0,0 +1,69 @@
+// Host run of the analog pad's command model (padcmd.c): the config commands
+// a game sends to a DualShock (SCPH-1200), and what the adapter answers.
+//
+// Build: the padtest target of CMakeLists.txt here; the pad_config test holds
+// its output against test/pad_config.txt
+// Usage: padtest
+//
+// A line per command: the command and parameter bytes, the ID of the reply,
+// then its bytes after 0x5A; "poll" for the pad frame, "-" if the command is
+// not answered in that mode.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "padcmd.h"
+
+typedef struct {
+  uint8_t cmd;
+  uint8_t params[PAD_PARAMS];
+} Command;
+
+// the order libpad goes through on a DualShock
+static const Command COMMANDS[] = {
+    {0x42, {0}},
+    {0x45, {0}},
+    {0x43, {0x01}},
+    {0x45, {0}},
+    {0x41, {0}},
+    {0x46, {0x00}},
+    {0x46, {0x01}},
+    {0x47, {0x00}},
+    {0x4C, {0x00}},
+    {0x4C, {0x01}},
+    {0x4D, {0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF}},
+    {0x4D, {0}},
+    {0x44, {0x00, 0x03}},
+    {0x45, {0}},
+    {0x41, {0}},
+    {0x43, {0x00}},
+    {0x42, {0}},
+};
+
+int main() {
+  PadMode m;
+  padModeInit(&m);
+  for (uint32_t i = 0; i != sizeof(COMMANDS) / sizeof(COMMANDS[0]); ++i) {
+    const Command *c = COMMANDS + i;
+    printf("%02x", c->cmd);
+    for (uint32_t p = 0; p != PAD_PARAMS; ++p) {
+      printf(" %02x", c->params[p]);
+    }
+    const uint8_t id = padId(&m);
+    const int r = padReply(&m, c->cmd, c->params[0]);
+    if (r < 0) {
+      printf(": -\n");
+    } else if (r == PAD_REPLY_POLL) {
+      printf(": %02x poll\n", id);
+    } else {
+      const uint8_t *reply = m.replies[r];
+      printf(": %02x", id);
+      for (uint32_t b = 2; b != PAD_REPLY_SIZE; ++b) {
+        printf(" %02x", reply[b]);
+      }
+      printf("\n");
+    }
+    padCommandDone(&m, c->cmd, c->params);
+  }
+  return 0;
+}
@@ -0,0 +1,221 @@
+// Decoder for PS1 bus captures (PSX_CAPTURE in usb-ps1-adapter.c).
+//
+// Build: cc -O2 -o psxcap psxcap.c
+// Usage: psxcap < serial.log
+//
+// Reads the capture lines from the adapter's stdio log, rebuilds the
+// transactions of every capture window and reports clock period, inter-byte
+// gap and ACK timing.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// must match capture.h
+#define PIN_ATT (1u << 0)
+#define PIN_CLK (1u << 3)
+#define PIN_DAT (1u << 4)
+#define PIN_CMD (1u << 7)
+#define PIN_ACK (1u << 8)
+#define CAPTURE_EXT 0x8000
+
+#define MAX_BYTES 32
+
+typedef struct {
+  double min;
+  double max;
+  double sum;
+  uint32_t count;
+} Stat;
+
+typedef struct {
+  uint16_t dt;
+  uint16_t pins;
+} Record;
+
+static Record *gRecs = NULL;
+static size_t gRecCount = 0;
+static size_t gRecCap = 0;
+static double gTickHz = 30000000.0;
+
+static void statAdd(Stat *s, double v) {
+  if (s->count == 0 || v < s->min) {
+    s->min = v;
+  }
+  if (s->count == 0 || v > s->max) {
+    s->max = v;
+  }
+  s->sum += v;
+  ++s->count;
+}
+
+static void statPrint(const char *name, const Stat *s) {
+  if (s->count == 0) {
+    printf("  %-16s n/a\n", name);
+    return;
+  }
+  printf("  %-16s min %8.2f us  avg %8.2f us  max %8.2f us  (%u)\n", name,
+         s->min, s->sum / s->count, s->max, s->count);
+}
+
+// value of "key":"..." in a log line, copied into out
+static int jsonField(const char *line, const char *key, char *out,
+                     size_t outLen) {
+  char pat[64];
+  snprintf(pat, sizeof(pat), "\"%s\":\"", key);
+  const char *p = strstr(line, pat);
+  if (!p) {
+    return 0;
+  }
+  p += strlen(pat);
+  size_t n = 0;
+  while (p[n] && p[n] != '"' && n + 1 < outLen) {
+    out[n] = p[n];
+    ++n;
+  }
+  out[n] = 0;
+  return 1;
+}
+
+static void addRecords(const char *hex) {
+  size_t len = strlen(hex);
+  for (size_t i = 0; i + 8 <= len; i += 8) {
+    char tmp[5] = {0};
+    if (gRecCount == gRecCap) {
+      gRecCap = gRecCap ? gRecCap * 2 : 4096;
+      gRecs = realloc(gRecs, gRecCap * sizeof(Record));
+      if (!gRecs) {
+        perror("realloc");
+        exit(1);
+      }
+    }
+    memcpy(tmp, hex + i, 4);
+    gRecs[gRecCount].dt = (uint16_t)strtoul(tmp, NULL, 16);
+    memcpy(tmp, hex + i + 4, 4);
+    gRecs[gRecCount].pins = (uint16_t)strtoul(tmp, NULL, 16);
+    ++gRecCount;
+  }
+}
+
+static double toUs(uint64_t ticks) { return ticks * 1e6 / gTickHz; }
+
+static void decodeWindow(const char *window) {
+  Stat clk = {0}, gap = {0}, ackDelay = {0}, ackWidth = {0}, txLen = {0};
+  uint64_t t = 0, ext = 0;
+  uint16_t pins = 0;
+  int havePins = 0;
+  int inTx = 0;
+  uint64_t txStart = 0, lastRise = 0, byteEnd = 0, ackStart = 0;
+  uint8_t cmd[MAX_BYTES], dat[MAX_BYTES];
+  int bitIndex = 0, byteCount = 0, acks = 0;
+
+  printf("window %s: %zu records, %.0f Hz ticks\n", window, gRecCount,
+         gTickHz);
+  for (size_t i = 0; i != gRecCount; ++i) {
+    const Record *r = gRecs + i;
+    if (r->pins & CAPTURE_EXT) {
+      ext += (uint64_t)r->dt << 16;
+      continue;
+    }
+    t += ext + r->dt;
+    ext = 0;
+    const uint16_t prev = pins;
+    pins = r->pins;
+    if (!havePins) {
+      havePins = 1;
+      continue; // initial state only
+    }
+    const uint16_t fell = prev & ~pins;
+    const uint16_t rose = ~prev & pins;
+
+    if (fell & PIN_ATT) {
+      inTx = 1;
+      txStart = t;
+      bitIndex = byteCount = acks = 0;
+      memset(cmd, 0, sizeof(cmd));
+      memset(dat, 0, sizeof(dat));
+    }
+    if (inTx && (fell & PIN_CLK) && bitIndex == 0 && byteCount > 0) {
+      statAdd(&gap, toUs(t - byteEnd));
+    }
+    if (inTx && (rose & PIN_CLK) && byteCount < MAX_BYTES) {
+      if (bitIndex > 0) {
+        statAdd(&clk, toUs(t - lastRise));
+      }
+      lastRise = t;
+      if (pins & PIN_CMD) {
+        cmd[byteCount] |= 1 << bitIndex;
+      }
+      if (pins & PIN_DAT) {
+        dat[byteCount] |= 1 << bitIndex;
+      }
+      if (++bitIndex == 8) {
+        bitIndex = 0;
+        ++byteCount;
+        byteEnd = t;
+      }
+    }
+    if (inTx && (fell & PIN_ACK)) {
+      statAdd(&ackDelay, toUs(t - byteEnd));
+      ackStart = t;
+      ++acks;
+    }
+    if ((rose & PIN_ACK) && ackStart) {
+      statAdd(&ackWidth, toUs(t - ackStart));
+      ackStart = 0;
+    }
+    if (inTx && (rose & PIN_ATT)) {
+      inTx = 0;
+      statAdd(&txLen, toUs(t - txStart));
+      printf("  %12.1f us  cmd", toUs(txStart));
+      for (int b = 0; b != byteCount; ++b) {
+        printf(" %02x", cmd[b]);
+      }
+      printf("  dat");
+      for (int b = 0; b != byteCount; ++b) {
+        printf(" %02x", dat[b]);
+      }
+      printf("  ack %d/%d%s\n", acks, byteCount, bitIndex ? "  (partial)" : "");
+    }
+  }
+  statPrint("clock period", &clk);
+  statPrint("inter-byte gap", &gap);
+  statPrint("ACK delay", &ackDelay);
+  statPrint("ACK width", &ackWidth);
+  statPrint("transaction", &txLen);
+  gRecCount = 0;
+}
+
+int main(void) {
+  static char line[1 << 16];
+  char value[64];
+  char window[32] = "?";
+  while (fgets(line, sizeof(line), stdin)) {
+    if (!strstr(line, "\"event\":\"capture")) {
+      continue;
+    }
+    if (strstr(line, "\"event\":\"capture_start\"")) {
+      gRecCount = 0;
+      if (jsonField(line, "tick_hz", value, sizeof(value))) {
+        gTickHz = atof(value);
+      }
+      jsonField(line, "window", window, sizeof(window));
+    } else if (strstr(line, "\"event\":\"capture_end\"")) {
+      decodeWindow(window);
+    } else {
+      const char *p = strstr(line, "\"data\":\"");
+      if (p) {
+        char *end;
+        p += strlen("\"data\":\"");
+        end = strchr(p, '"');
+        if (end) {
+          *end = 0;
+        }
+        addRecords(p);
+      }
+    }
+  }
+  free(gRecs);
+  return 0;
+}
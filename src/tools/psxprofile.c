@@ -0,0 +1,175 @@
+// Builds a UF2 image of the adapter's profile store (profile.h).
+//
+// Build: the psxprofile target of CMakeLists.txt here
+// Usage: psxprofile [flash size in KiB] < profiles.txt > profiles.uf2
+//
+// Copy the UF2 onto the Pico in BOOTSEL mode like the firmware itself. It
+// only covers the store at the end of flash, the firmware is kept. The input
+// describes the profiles to store; any other profile is the built-in key map:
+//
+//   profile 1          # following lines set profile 1 (0-3)
+//   speed 12           # mouse motion in 1/8, 8 = as reported
+//   gain 10 12         # the same in 1/256 for X and Y, replaces speed
+//   accel 8 24         # gain added per count/ms in 1/16, up to 24/8 = 3x
+//   smooth 1           # turns back of up to 1 count are jitter
+//   swap               # swap the mouse buttons
+//   analog             # mouse and keyboard are one analog pad (0x73)
+//   key 2c cross       # keyboard usage (hex), then pad buttons
+//   key e1 l1 l2
+//   key f0 r1          # f0/f1: left/right mouse button in analog mode
+//   active 1           # profile used after power-up
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+// must match usb-ps1-adapter.c
+#define STORE_SECTORS 4
+#define SECTOR_SIZE 4096
+#define STORE_SIZE (STORE_SECTORS * SECTOR_SIZE)
+#define XIP_BASE 0x10000000
+
+#define UF2_FAMILY_RP2040 0xe48bff56
+
+static uint8_t gStore[STORE_SIZE];
+
+static void simErase(uint32_t offset) {
+  memset(gStore + offset, 0xff, SECTOR_SIZE);
+}
+
+static void simProgram(uint32_t offset, const uint8_t *page) {
+  for (uint32_t i = 0; i != PROFILE_PAGE; ++i) {
+    gStore[offset + i] &= page[i];
+  }
+}
+
+// pad button bits, as in KEY_BUTTON_MAP
+static const char *BUTTON_NAMES[16] = {
+    "select", "l3", "r3", "start", "up", "right", "down", "left",
+    "l2", "r2", "l1", "r1", "triangle", "circle", "cross", "square"};
+
+static int buttonBit(const char *name) {
+  for (int i = 0; i != 16; ++i) {
+    if (strcmp(name, BUTTON_NAMES[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static void writeUf2(uint32_t flashSize) {
+  const uint32_t blocks = STORE_SIZE / PROFILE_PAGE;
+  const uint32_t addr = XIP_BASE + flashSize - STORE_SIZE;
+  for (uint32_t i = 0; i != blocks; ++i) {
+    uint8_t b[512];
+    memset(b, 0, sizeof(b));
+    put32(b, 0x0A324655);
+    put32(b + 4, 0x9E5D5157);
+    put32(b + 8, 0x2000); // family ID present
+    put32(b + 12, addr + i * PROFILE_PAGE);
+    put32(b + 16, PROFILE_PAGE);
+    put32(b + 20, i);
+    put32(b + 24, blocks);
+    put32(b + 28, UF2_FAMILY_RP2040);
+    memcpy(b + 32, gStore + i * PROFILE_PAGE, PROFILE_PAGE);
+    put32(b + 508, 0x0AB16F30);
+    fwrite(b, 1, sizeof(b), stdout);
+  }
+}
+
+int main(int argc, char **argv) {
+  const uint32_t flashSize = (argc > 1 ? atoi(argv[1]) : 2048) * 1024;
+  if (flashSize <= STORE_SIZE) {
+    fprintf(stderr, "psxprofile: bad flash size\n");
+    return 1;
+  }
+
+  static const ProfileFlash flash = {gStore, STORE_SIZE, SECTOR_SIZE,
+                                     simErase, simProgram};
+  ProfileStore st;
+  memset(gStore, 0xff, sizeof(gStore));
+  profileLoad(&st, &flash);
+
+  char line[256];
+  int lineNo = 0;
+  Profile *p = NULL;
+  while (fgets(line, sizeof(line), stdin)) {
+    ++lineNo;
+    char *hash = strchr(line, '#');
+    if (hash) {
+      *hash = 0;
+    }
+    char *word = strtok(line, " \t\r\n");
+    if (!word) {
+      continue;
+    }
+    char *arg = strtok(NULL, " \t\r\n");
+    if (strcmp(word, "profile") == 0 || strcmp(word, "active") == 0) {
+      const int i = arg ? atoi(arg) : -1;
+      if (i < 0 || i >= PROFILES) {
+        fprintf(stderr, "psxprofile:%d: profile 0-%d\n", lineNo, PROFILES - 1);
+        return 1;
+      }
+      if (word[0] == 'a') {
+        profileSelect(&st, i);
+        continue;
+      }
+      p = st.profiles + i;
+      memset(p, 0, sizeof(*p));
+      p->mouseSpeed = PROFILE_SPEED_1X;
+      profileSave(&st, i);
+    } else if (!p) {
+      fprintf(stderr, "psxprofile:%d: no profile line before\n", lineNo);
+      return 1;
+    } else if (strcmp(word, "speed") == 0 && arg) {
+      p->mouseSpeed = atoi(arg);
+    } else if (strcmp(word, "gain") == 0 && arg) {
+      const char *y = strtok(NULL, " \t\r\n");
+      p->motion.gainX = atoi(arg);
+      p->motion.gainY = y ? atoi(y) : 0;
+    } else if (strcmp(word, "accel") == 0 && arg) {
+      const char *max = strtok(NULL, " \t\r\n");
+      p->motion.accel = atoi(arg);
+      p->motion.accelMax = max ? atoi(max) : 0;
+    } else if (strcmp(word, "smooth") == 0 && arg) {
+      p->motion.smooth = atoi(arg);
+    } else if (strcmp(word, "swap") == 0) {
+      p->flags |= PROFILE_SWAP_BUTTONS;
+    } else if (strcmp(word, "analog") == 0) {
+      p->flags |= PROFILE_ANALOG;
+    } else if (strcmp(word, "key") == 0 && arg) {
+      if (p->keyCount == PROFILE_KEYS) {
+        fprintf(stderr, "psxprofile:%d: over %d keys\n", lineNo, PROFILE_KEYS);
+        return 1;
+      }
+      KeyBinding *k = p->keys + p->keyCount++;
+      k->key = strtoul(arg, NULL, 16);
+      while ((arg = strtok(NULL, " \t\r\n"))) {
+        const int bit = buttonBit(arg);
+        if (bit < 0) {
+          fprintf(stderr, "psxprofile:%d: unknown button %s\n", lineNo, arg);
+          return 1;
+        }
+        k->buttons |= 1 << bit;
+      }
+    } else {
+      fprintf(stderr, "psxprofile:%d: cannot parse\n", lineNo);
+      return 1;
+    }
+  }
+
+  while (profileFlush(&st, 1)) {
+  }
+  writeUf2(flashSize);
+  return 0;
+}
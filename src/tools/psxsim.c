@@ -0,0 +1,1359 @@
+// Host build of the adapter firmware on a virtual-time PS1 bus and USB host.
+//
+// Build: the psxsim target of CMakeLists.txt here, with the other tools
+//        cmake -S . -B build && cmake --build build
+// Usage: psxsim [options] [usb.jsonl] > sim.jsonl
+//
+// usb-ps1-adapter.c is compiled in unchanged, against the stand-in SDK in
+// simsdk/. psxsim plays the console: it polls at the frame rate, clocks every
+// byte at the SIO rate and waits for ACK the way psx_sio.pio sees it from the
+// other side. The USB devices are a recording in the JSON lines of psxtrace;
+// its mount, umount and report events are replayed at their timestamps.
+//
+// Firmware code runs on the host at the virtual time of the event it handles.
+// Its host run time, times the -s factor, is what it takes on the RP2040, so a
+// verdict is queued at the virtual time pio_sm_put() is reached. Core0 also
+// needs up to one idle pass of SM_task() to notice an event; while it watches
+// CLK, each read is a loop pass of SIM_CLK_READ_NS. The factor is a guess to
+// start from; compare the reaction times with PSX_CAPTURE on the hardware once
+// and pass the factor that matches.
+//
+// Options:
+//   -c khz   SIO clock (default 250)
+//   -r hz    polls per second, 0 = back to back (default 59.94)
+//   -g us    gap between ACK and the next byte (default 10)
+//   -a us    how long the console waits for ACK (default 100)
+//   -m       ask for the multitap reply (0x01 in byte 2)
+//   -x n     cut every other poll short: ATT goes up after n bytes
+//   -d ms    no polls for the first ms of every second, as while loading
+//   -s x     RP2040 time per host time (default 30)
+//   -t s     virtual seconds to run (default: the recording plus 1, or 10)
+//   -p n     hot-plug n synthetic devices instead of a recording (usbSynth)
+//   -k n     n mice reporting at 1000 Hz together instead (usbMice)
+//   -n hz    a mouse moving all the time instead, polled at hz once asked
+//            for a report (moverRun); not with -m
+//   -b       boot interfaces without a descriptor stay in report protocol when
+//            asked to switch, and theirs cannot be fetched either
+//   -w       ask mice for reports just ahead of the polls, as with POLL_ALIGN
+//   -l       model the mutex core0 took after the first command byte before
+//            the lock-free handoff: while core1 handles a USB event or runs
+//            its loop, that verdict waits for it (mutex_wait)
+//   -f uf2   flash contents, e.g. a profile store made by psxprofile
+//   -o uf2   write the profile store at the end, for -f of the next run
+//   -v       print every poll
+//
+// The output is JSON lines: the polls with -v, the firmware's statistics
+// (latencyPrint), then a "sim" summary. sent_x and sent_y are the motion
+// per slot core0 committed as sent in polls with a mouse reply for the slot,
+// to hold against those replies; what it drops on an unplug is left out.
+// ack_margin is how long before the
+// ACK delay of psx_sio ran out the verdict was queued; late_acks counts the
+// verdicts that came after it. report_host_ns is what a USB report costs
+// core1 on the host, report_rp2040_us the same scaled by -s: with -k n, n of
+// them have to fit in the 1 ms between reports. lookup_host_ns the device
+// lookup alone and
+// motion_host_ns the motion stage of the active profile. usb_reports are
+// the reports the devices had, usb_waited those that waited for the firmware
+// to ask for them, usb_lost those replaced by a newer one meanwhile or never
+// asked for. profile_active and
+// profile_pending are the profile store at the end, with the flash sectors
+// erased and pages programmed on the way. core1_pass_ns is a
+// pass of the core1 scheduler without USB events, every SIM_CORE1_PASS_NS;
+// its max bounds how long tuh_task() waits. core1_load is
+// the part of the RP2040's time core1 spends on USB events. With -n,
+// motion_age is how old each count of the mouse was when the poll carrying
+// it started, motion_fresh the same for the newest count of each poll. Runs
+// the host spent preempted are taken as instant and counted in host_outliers.
+// To profile, run with -r 0 under perf or gprof.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define main adapterMain
+#include "usb-ps1-adapter.c"
+#undef main
+
+#define SIM_ATT_LEAD_NS 20000     // ATT fall to the first clock edge
+#define SIM_ATT_TRAIL_NS 10000    // last byte to ATT rise
+#define SIM_USB_START_NS 50000000 // first recorded USB event
+#define SIM_CMD_SIZE (TAP_SIZE + 1)
+#define SIM_IDLE_PASSES 100000
+#define SIM_HOST_OUTLIER_NS 20000 // host run this long was preempted
+#define SIM_CLK_READ_NS 150        // core0 loop pass polling CLK
+#define SIM_CORE1_PASS_NS 10000   // core1 loop pass without USB events
+
+// psx_sio's own cycles as siopio runs them (test/psx_sio.txt): from the last
+// rising CLK edge of a byte to its push to the RX FIFO and to the end of the
+// ACK delay loop's first pass, and from the verdict pulled to ACK
+#define SIM_SIO_PUSH_CYCLES 4
+#define SIM_SIO_LOOP_CYCLES 13
+#define SIM_SIO_ACK_CYCLES 5
+#define SIM_SIO_CYCLE_NS ((uint64_t)(1e9 / SIO_FREQ))
+
+typedef struct {
+  uint32_t khz;
+  double pollHz;
+  uint32_t gapUs;
+  uint32_t ackTimeoutUs;
+  bool tap;
+  double scale;
+  double seconds;
+  bool verbose;
+  uint32_t moverHz;
+  bool mutex;
+  uint32_t cutBytes;
+  uint32_t pauseMs;
+  bool bootRefused;
+} SimOptions;
+
+static SimOptions gOpt = {
+    250, 59.94, 10, 100, false, 30, 0, false, 0, false, 0, 0, false};
+
+static uint64_t gSimNs = 0; // virtual time
+static bool gSimAtt = true;
+
+//--------------------------------------------------------------------+
+// SDK stand-ins
+//--------------------------------------------------------------------+
+
+uint8_t gSimFlash[PICO_FLASH_SIZE_BYTES];
+static uint32_t gSimErases;
+static uint32_t gSimPrograms;
+
+absolute_time_t get_absolute_time(void) { return gSimNs / 1000; }
+uint32_t time_us_32(void) { return gSimNs / 1000; }
+uint64_t time_us_64(void) { return gSimNs / 1000; }
+void sleep_us(uint64_t us) { gSimNs += us * 1000; }
+void sleep_ms(uint32_t ms) { gSimNs += ms * 1000000ull; }
+
+void hard_assert(bool condition) {
+  if (!condition) {
+    fprintf(stderr, "psxsim: firmware assertion failed\n");
+    abort();
+  }
+}
+
+void flash_range_erase(uint32_t offset, size_t count) {
+  ++gSimErases;
+  memset(gSimFlash + offset, 0xff, count);
+}
+
+void flash_range_program(uint32_t offset, const uint8_t *data, size_t count) {
+  ++gSimPrograms;
+  for (size_t i = 0; i != count; ++i) {
+    gSimFlash[offset + i] &= data[i];
+  }
+}
+
+static uint64_t hostNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// psx_sio as seen from the CPU: the command bytes it pushed, and the words
+// queued for it with the virtual time they were queued at. The byte being
+// clocked in shows up in the RX FIFO at its last clock edge; core0 may watch
+// CLK meanwhile.
+typedef struct {
+  uint32_t rx[4];
+  uint8_t rxCount;
+  bool clocking;   // a byte is on the bus
+  uint8_t cmd;     // that byte
+  uint64_t byteNs; // its first falling CLK edge
+  uint64_t bitNs;
+  uint32_t tx[4];
+  uint64_t txNs[4];
+  uint8_t txCount;
+  uint64_t runStartNs;   // virtual time the current core0 run started at
+  uint64_t runStartHost; // host time of the same
+} SimSio;
+
+static SimSio gSio;
+
+
+// the console clocks cmd starting at virtual time at
+static void sioClock(uint8_t cmd, uint64_t at, uint64_t bitNs) {
+  gSio.clocking = true;
+  gSio.cmd = cmd;
+  gSio.byteNs = at;
+  gSio.bitNs = bitNs;
+}
+
+// the byte on the bus is in the RX FIFO
+static uint64_t sioPushed() {
+  return gSio.byteNs + 8 * gSio.bitNs - gSio.bitNs / 2 +
+         SIM_SIO_PUSH_CYCLES * SIM_SIO_CYCLE_NS;
+}
+
+static void sioReceive() {
+  if (gSio.clocking && gSimNs >= sioPushed() && gSio.rxCount != 4) {
+    gSio.rx[gSio.rxCount++] = (uint32_t)gSio.cmd << 24;
+    gSio.clocking = false;
+  }
+}
+
+// A CLK read is one pass of a polling loop on core0; host time only counts
+// from the last one on.
+bool gpio_get(uint gpio) {
+  if (gpio == GP_ATT) {
+    return gSimAtt;
+  }
+  if (gpio != GP_CLK) {
+    return true;
+  }
+  gSimNs += SIM_CLK_READ_NS;
+  gSio.runStartNs = gSimNs;
+  gSio.runStartHost = hostNs();
+  if (!gSio.clocking || gSimNs < gSio.byteNs) {
+    return true;
+  }
+  const uint64_t t = gSimNs - gSio.byteNs;
+  return t >= 8 * gSio.bitNs || t % gSio.bitNs >= gSio.bitNs / 2;
+}
+static struct pio_hw gSimPio;
+
+bool pio_claim_free_sm_and_add_program_for_gpio_range(
+    const struct pio_program *program, PIO *pio, uint *sm, uint *offset,
+    uint gpio_base, uint gpio_count, bool set_gpio_base) {
+  (void)program;
+  (void)gpio_base;
+  (void)gpio_count;
+  (void)set_gpio_base;
+  *pio = &gSimPio;
+  *sm = 0;
+  *offset = 0;
+  return true;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+  (void)pio;
+  (void)sm;
+  if (gSio.txCount == 4) {
+    return; // full, the word is lost like on the hardware
+  }
+  const uint64_t host = hostNs() - gSio.runStartHost;
+  gSio.tx[gSio.txCount] = data;
+  gSio.txNs[gSio.txCount] = gSio.runStartNs + (uint64_t)(host * gOpt.scale);
+  ++gSio.txCount;
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+  pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+  (void)pio;
+  (void)sm;
+  sioReceive();
+  if (gSio.rxCount == 0) {
+    return 0;
+  }
+  const uint32_t w = gSio.rx[0];
+  memmove(gSio.rx, gSio.rx + 1, --gSio.rxCount * sizeof(gSio.rx[0]));
+  return w;
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+  (void)pio;
+  (void)sm;
+  sioReceive();
+  return gSio.rxCount == 0;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+  (void)pio;
+  (void)sm;
+  gSio.rxCount = 0;
+  gSio.txCount = 0;
+}
+
+// the state machine pulls a word, false if it would block
+static bool sioPull(uint32_t *word, uint64_t *at) {
+  if (gSio.txCount == 0) {
+    return false;
+  }
+  *word = gSio.tx[0];
+  *at = gSio.txNs[0];
+  --gSio.txCount;
+  memmove(gSio.tx, gSio.tx + 1, gSio.txCount * sizeof(gSio.tx[0]));
+  memmove(gSio.txNs, gSio.txNs + 1, gSio.txCount * sizeof(gSio.txNs[0]));
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Recorded USB devices
+//--------------------------------------------------------------------+
+
+#define SIM_MOUNT 1
+#define SIM_UMOUNT 2
+#define SIM_REPORT 3
+
+typedef struct {
+  uint64_t ns; // virtual time
+  uint8_t type;
+  uint8_t addr;
+  uint8_t instance;
+  uint8_t protocol;
+  uint16_t vid;
+  uint16_t pid;
+  uint16_t len;
+  uint8_t *data;
+} SimUsbEvent;
+
+static SimUsbEvent *gUsb = NULL;
+static size_t gUsbCount = 0;
+static size_t gUsbCap = 0;
+static size_t gUsbNext = 0;
+
+static void usbAdd(const SimUsbEvent *e) {
+  if (gUsbCount == gUsbCap) {
+    gUsbCap = gUsbCap ? gUsbCap * 2 : 256;
+    gUsb = realloc(gUsb, gUsbCap * sizeof(*gUsb));
+  }
+  gUsb[gUsbCount++] = *e;
+}
+
+static uint8_t gSimProtocol[256][16]; // by address and instance
+static uint16_t gSimVid[256];
+static uint16_t gSimPid[256];
+
+uint8_t tuh_hid_interface_protocol(uint8_t dev_addr, uint8_t idx) {
+  return idx < 16 ? gSimProtocol[dev_addr][idx] : 0;
+}
+
+bool tuh_vid_pid_get(uint8_t dev_addr, uint16_t *vid, uint16_t *pid) {
+  *vid = gSimVid[dev_addr];
+  *pid = gSimPid[dev_addr];
+  return true;
+}
+
+// The -n mouse: it moves one count to the right every millisecond from its
+// mount on and reports what it has gathered when the host polls it. Once
+// asked for a report, the host polls it from the next USB frame on at its
+// interval until it has something.
+#define MOVER_ADDR 1
+#define MOVER_FRAME_NS 1000000ull
+
+typedef struct {
+  uint64_t mountNs;
+  uint64_t intervalNs;
+  bool armed;
+  uint64_t pollNs;   // next host poll while armed
+  uint32_t sent; // counts reported
+} SimMover;
+
+static SimMover gMover;
+
+static uint32_t moverCounts(uint64_t ns) {
+  return ns > gMover.mountNs ? (ns - gMover.mountNs) / MOVER_FRAME_NS : 0;
+}
+
+// The other devices only send a report once the firmware has asked for it
+// with tuh_hid_receive_report(). Until then a device keeps its newest report
+// and loses the one before, as a keyboard does; a mouse would add up its
+// motion, but only as far as a report holds.
+#define SIM_HELD_MAX 64
+
+typedef struct {
+  uint8_t addr;
+  uint8_t instance;
+  uint32_t event; // in gUsb
+} SimHeld;
+
+static bool gSimArmed[256][16]; // by address and instance
+static SimHeld gSimHeld[SIM_HELD_MAX];
+static uint32_t gSimHeldCount;
+static uint32_t gSimReports; // recorded or made up, sent or not
+static uint32_t gSimWaited;  // sent once the firmware asked
+static uint32_t gSimLost;    // replaced by a newer one, or never asked for
+
+static int heldFind(uint8_t addr, uint8_t instance) {
+  for (uint32_t i = 0; i != gSimHeldCount; ++i) {
+    if (gSimHeld[i].addr == addr && gSimHeld[i].instance == instance) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void heldDrop(uint32_t i) {
+  gSimHeld[i] = gSimHeld[--gSimHeldCount];
+}
+
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t idx) {
+  if (!gOpt.moverHz || dev_addr != MOVER_ADDR || idx != 0) {
+    if (idx >= 16 || gSimArmed[dev_addr][idx]) {
+      return false; // a transfer is pending already
+    }
+    gSimArmed[dev_addr][idx] = true;
+    return true;
+  }
+  if (gMover.armed) {
+    return false; // a transfer is pending already
+  }
+  gMover.armed = true;
+  gMover.pollNs = (gSimNs / MOVER_FRAME_NS) * MOVER_FRAME_NS +
+                  gMover.intervalNs;
+  return true;
+}
+
+// SET_PROTOCOL requested in a callback, completed after it
+static struct {
+  bool pending;
+  uint8_t addr;
+  uint8_t idx;
+  uint8_t protocol;
+} gSimSetProtocol;
+
+bool tuh_hid_set_protocol(uint8_t dev_addr, uint8_t idx, uint8_t protocol) {
+  if (gSimSetProtocol.pending) {
+    return false; // the control endpoint is busy
+  }
+  gSimSetProtocol.pending = true;
+  gSimSetProtocol.addr = dev_addr;
+  gSimSetProtocol.idx = idx;
+  gSimSetProtocol.protocol = gOpt.bootRefused ? HID_PROTOCOL_REPORT : protocol;
+  return true;
+}
+
+// the recordings have no descriptor to give beyond the one they mount with
+bool tuh_hid_mounted(uint8_t dev_addr, uint8_t idx) {
+  (void)dev_addr;
+  (void)idx;
+  return true;
+}
+
+bool tuh_hid_itf_get_info(uint8_t daddr, uint8_t idx, tuh_itf_info_t *info) {
+  info->daddr = daddr;
+  info->desc.bInterfaceNumber = idx;
+  return true;
+}
+
+bool tuh_descriptor_get_hid_report(uint8_t daddr, uint8_t itf_num,
+                                   uint8_t desc_type, uint8_t index,
+                                   void *buffer, uint16_t len,
+                                   tuh_xfer_cb_t complete_cb,
+                                   uintptr_t user_data) {
+  (void)daddr;
+  (void)itf_num;
+  (void)desc_type;
+  (void)index;
+  (void)buffer;
+  (void)len;
+  (void)complete_cb;
+  (void)user_data;
+  return false;
+}
+
+// value of "name":"..." in a JSON line, empty if there is none
+static void jsonField(const char *line, const char *name, char *buf,
+                      size_t size) {
+  char key[32];
+  snprintf(key, sizeof(key), "\"%s\":\"", name);
+  const char *p = strstr(line, key);
+  buf[0] = 0;
+  if (!p) {
+    return;
+  }
+  p += strlen(key);
+  size_t n = 0;
+  while (p[n] && p[n] != '"' && n + 1 < size) {
+    ++n;
+  }
+  memcpy(buf, p, n);
+  buf[n] = 0;
+}
+
+static void usbLoad(FILE *f) {
+  static char line[0x30000];
+  static char value[sizeof(line)];
+  uint64_t firstUs = 0;
+  while (fgets(line, sizeof(line), f)) {
+    SimUsbEvent e;
+    memset(&e, 0, sizeof(e));
+    jsonField(line, "event", value, sizeof(value));
+    if (strcmp(value, "mount") == 0) {
+      e.type = SIM_MOUNT;
+    } else if (strcmp(value, "umount") == 0) {
+      e.type = SIM_UMOUNT;
+    } else if (strcmp(value, "report") == 0) {
+      e.type = SIM_REPORT;
+    } else {
+      continue;
+    }
+    jsonField(line, "timestamp", value, sizeof(value));
+    const uint64_t us = strtoull(value, NULL, 10);
+    if (gUsbCount == 0) {
+      firstUs = us;
+    }
+    e.ns = SIM_USB_START_NS + (us - firstUs) * 1000;
+    jsonField(line, "address", value, sizeof(value));
+    e.addr = atoi(value);
+    jsonField(line, "instance", value, sizeof(value));
+    e.instance = atoi(value);
+    jsonField(line, "protocol", value, sizeof(value));
+    e.protocol = strcmp(value, "Mouse") == 0      ? HID_ITF_PROTOCOL_MOUSE
+                 : strcmp(value, "Keyboard") == 0 ? HID_ITF_PROTOCOL_KEYBOARD
+                                                  : HID_ITF_PROTOCOL_NONE;
+    jsonField(line, "vid", value, sizeof(value));
+    e.vid = strtoul(value, NULL, 16);
+    jsonField(line, "pid", value, sizeof(value));
+    e.pid = strtoul(value, NULL, 16);
+    jsonField(line, "data", value, sizeof(value));
+    e.data = malloc(strlen(value) / 2 + 1);
+    for (char *p = value, *end; e.len != 0xffff; p = end) {
+      const unsigned long b = strtoul(p, &end, 16);
+      if (end == p) {
+        break;
+      }
+      e.data[e.len++] = b;
+    }
+    usbAdd(&e);
+  }
+}
+
+#define SYNTH_PERIOD_NS 250000000ull // between plug-ins
+#define SYNTH_LIFE_NS 1600000000ull  // plugged in for
+#define SYNTH_MOUSE_NS 1000000       // 1000 Hz mouse reports
+#define SYNTH_KEYB_NS 8000000        // keyboard reports, a key change each
+
+static const uint8_t SYNTH_MOUSE_DESCR[] = {
+    0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x09, 0x01, 0xa1, 0x00, 0x05,
+    0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03,
+    0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05, 0x81, 0x01, 0x05,
+    0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7f,
+    0x75, 0x08, 0x95, 0x03, 0x81, 0x06, 0xc0, 0xc0};
+
+static const uint8_t SYNTH_KEYB_DESCR[] = {
+    0x05, 0x01, 0x09, 0x06, 0xa1, 0x01, 0x05, 0x07, 0x19, 0xe0, 0x29,
+    0xe7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x06, 0x75, 0x08, 0x15,
+    0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+    0xc0};
+
+// a receiver: keyboard (ID 1) and mouse (ID 2) on one interface without a
+// boot protocol
+static const uint8_t SYNTH_COMBO_DESCR[] = {
+    0x05, 0x01, 0x09, 0x06, 0xa1, 0x01, 0x85, 0x01, 0x05, 0x07, 0x19,
+    0xe0, 0x29, 0xe7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08,
+    0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x06, 0x75,
+    0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65,
+    0x81, 0x00, 0xc0, 0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x85, 0x02,
+    0x09, 0x01, 0xa1, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15,
+    0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01,
+    0x75, 0x05, 0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09,
+    0x38, 0x15, 0x81, 0x25, 0x7f, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+    0xc0, 0xc0};
+
+static void synthAdd(uint64_t ns, uint8_t type, uint8_t addr, uint8_t idx,
+                     uint8_t protocol, uint16_t pid, const uint8_t *data,
+                     uint16_t len) {
+  SimUsbEvent e = {ns, type, addr, idx, protocol, 0x1209, pid, len, NULL};
+  e.data = malloc(len + 1);
+  memcpy(e.data, data, len);
+  usbAdd(&e);
+}
+
+// events in time order; at the same time an unplug goes before a plug-in,
+// which may get the same address
+static int synthOrder(const void *a, const void *b) {
+  const SimUsbEvent *x = a;
+  const SimUsbEvent *y = b;
+  if (x->ns != y->ns) {
+    return x->ns < y->ns ? -1 : 1;
+  }
+  static const uint8_t RANK[4] = {0, 1, 0, 2}; // umount, mount, report
+  return RANK[x->type] - RANK[y->type];
+}
+
+// Device k plugs in at k * SYNTH_PERIOD_NS for SYNTH_LIFE_NS: a boot mouse,
+// a boot keyboard, both on one device, or both on one interface, in turn.
+// Addresses and interface numbers are handed out lowest free first like
+// TinyUSB does; the hub has address 1. A device that finds none free is not
+// enumerated.
+static void usbSynth(uint32_t n) {
+  uint64_t addrFree[DEV_ADDRS] = {0}; // virtual time it is free again
+  uint64_t idxFree[CFG_TUH_HID] = {0};
+  uint32_t enumerated = 0;
+  for (uint32_t k = 0; k != n; ++k) {
+    const uint64_t plug = SIM_USB_START_NS + k * SYNTH_PERIOD_NS;
+    const uint64_t unplug = plug + SYNTH_LIFE_NS;
+    const uint8_t kind = k % 4;
+    const uint8_t itfs = kind == 2 ? 2 : 1;
+    uint8_t addr = 2;
+    while (addr < DEV_ADDRS && addrFree[addr] > plug) {
+      ++addr;
+    }
+    uint8_t idx[2];
+    uint8_t found = 0;
+    for (uint8_t i = 0; i != CFG_TUH_HID && found != itfs; ++i) {
+      if (idxFree[i] <= plug) {
+        idx[found++] = i;
+      }
+    }
+    if (addr == DEV_ADDRS || found != itfs) {
+      continue;
+    }
+    ++enumerated;
+    addrFree[addr] = unplug;
+    for (uint8_t i = 0; i != itfs; ++i) {
+      idxFree[idx[i]] = unplug;
+      const bool combo = kind == 3;
+      const bool mouse = kind == 0 || i == 1;
+      const uint8_t protocol = combo   ? HID_ITF_PROTOCOL_NONE
+                               : mouse ? HID_ITF_PROTOCOL_MOUSE
+                                       : HID_ITF_PROTOCOL_KEYBOARD;
+      const uint8_t *descr = combo   ? SYNTH_COMBO_DESCR
+                             : mouse ? SYNTH_MOUSE_DESCR
+                                     : SYNTH_KEYB_DESCR;
+      const uint16_t descrLen = combo   ? sizeof(SYNTH_COMBO_DESCR)
+                                : mouse ? sizeof(SYNTH_MOUSE_DESCR)
+                                        : sizeof(SYNTH_KEYB_DESCR);
+      synthAdd(plug, SIM_MOUNT, addr, idx[i], protocol, k, descr, descrLen);
+      synthAdd(unplug, SIM_UMOUNT, addr, idx[i], protocol, k, NULL, 0);
+      // a receiver sends both streams, each report after its ID
+      for (uint32_t part = 0; part != 2; ++part) {
+        const bool m = combo ? part == 1 : mouse;
+        if (part == 1 && !combo) {
+          break;
+        }
+        const uint64_t every = m ? SYNTH_MOUSE_NS : SYNTH_KEYB_NS;
+        uint32_t r = 0;
+        for (uint64_t t = plug + every; t < unplug; t += every, ++r) {
+          const uint8_t mr[5] = {2, r >> 6 & 1, (r & 7) - 3, (r >> 3 & 7) - 3,
+                                 0};
+          const uint8_t kr[9] = {1, 0, 0, r & 1 ? 0x04 + r % 26 : 0};
+          const uint8_t *rep = m ? mr + !combo : kr + !combo;
+          const uint16_t len = m ? sizeof(mr) - !combo : sizeof(kr) - !combo;
+          synthAdd(t, SIM_REPORT, addr, idx[i], protocol, k, rep, len);
+        }
+      }
+    }
+  }
+  qsort(gUsb, gUsbCount, sizeof(*gUsb), synthOrder);
+  fprintf(stderr, "psxsim: %u of %u synthetic devices enumerated\n",
+          enumerated, n);
+}
+
+// n boot mice behind the hub, plugged in 1 ms apart, each reporting every
+// millisecond from then until endNs; their reports are spread over the
+// millisecond
+static void usbMice(uint32_t n, uint64_t endNs) {
+  for (uint32_t k = 0; k != n; ++k) {
+    const uint8_t addr = 2 + k;
+    const uint64_t plug = SIM_USB_START_NS + k * SYNTH_MOUSE_NS;
+    synthAdd(plug, SIM_MOUNT, addr, 0, HID_ITF_PROTOCOL_MOUSE, 0x10 + k,
+             SYNTH_MOUSE_DESCR, sizeof(SYNTH_MOUSE_DESCR));
+    uint32_t r = 0;
+    for (uint64_t t = plug + SYNTH_MOUSE_NS + k * SYNTH_MOUSE_NS / n; t < endNs;
+         t += SYNTH_MOUSE_NS, ++r) {
+      const uint8_t m[4] = {r >> 6 & 1, (r & 7) - 3, (r >> 3 & 7) - 3, 0};
+      synthAdd(t, SIM_REPORT, addr, 0, HID_ITF_PROTOCOL_MOUSE, 0x10 + k, m,
+               sizeof(m));
+    }
+  }
+  qsort(gUsb, gUsbCount, sizeof(*gUsb), synthOrder);
+}
+
+static void moverMount(uint32_t hz) {
+  gMover.mountNs = SIM_USB_START_NS;
+  gMover.intervalNs = (1000 / hz > 1 ? 1000 / hz : 1) * MOVER_FRAME_NS;
+  synthAdd(gMover.mountNs, SIM_MOUNT, MOVER_ADDR, 0, HID_ITF_PROTOCOL_MOUSE,
+           0, SYNTH_MOUSE_DESCR, sizeof(SYNTH_MOUSE_DESCR));
+}
+
+//--------------------------------------------------------------------+
+// Cores
+//--------------------------------------------------------------------+
+
+typedef struct {
+  uint32_t polls;
+  uint32_t bytes;      // acknowledged
+  uint32_t lateAcks;   // verdict after the ACK delay
+  uint32_t lost;       // ACK later than the console waits
+  int64_t marginMinNs; // of the acknowledged bytes
+  Hist reaction;       // byte in the RX FIFO to verdict
+  Hist margin;
+  uint64_t core0Host; // host time spent in SM_task() handling events
+  uint32_t core0Runs;
+  uint64_t core1Host; // host time spent handling USB events
+  uint32_t core1Runs;
+  uint64_t reportHost; // the same for reports alone
+  uint64_t reportMaxNs;
+  uint32_t reportRuns;
+  double lookupNs; // host time of findDev()
+  double motionNs; // host time of motionApply()
+  Hist motionAge;  // -n: mouse motion to the poll carrying it
+  uint64_t motionAgeSum;
+  uint64_t motionFreshSum; // age of the newest count per poll
+  uint32_t motionPolls;
+  uint32_t hostOutliers;
+  uint64_t idleNs; // virtual time of an idle SM_task() pass
+  uint64_t passHost; // host time of core1Pass() between USB events
+  uint64_t passMaxNs;
+  uint32_t passRuns;
+  int32_t sentX[PAD_SLOTS]; // see motionCommitted()
+  int32_t sentY[PAD_SLOTS];
+} SimStats;
+
+static SimStats gStats = {.marginMinNs = INT64_MAX,
+                          .reaction = {.shift = 0},
+                          .margin = {.shift = 0},
+                          .motionAge = {.shift = 10}};
+
+static uint64_t gCore0Free = 0; // core0 busy until then
+static uint64_t gClockNs = 0;   // host cost of reading the clock
+static uint32_t gRandom = 1;
+
+static uint32_t simRandom() {
+  gRandom ^= gRandom << 13;
+  gRandom ^= gRandom >> 17;
+  gRandom ^= gRandom << 5;
+  return gRandom;
+}
+
+// core0 notices a change at `at` on one of its loop passes and runs it
+static void core0Run(uint64_t at) {
+  const uint64_t phase = gStats.idleNs ? simRandom() % gStats.idleNs : 0;
+  const uint64_t start = at + phase > gCore0Free ? at + phase : gCore0Free;
+  gSimNs = gSio.runStartNs = start;
+  gSio.runStartHost = hostNs();
+  SM_task();
+  uint64_t spent = hostNs() - gSio.runStartHost;
+  spent = spent > gClockNs ? spent - gClockNs : 0;
+  if (spent > SIM_HOST_OUTLIER_NS) {
+    ++gStats.hostOutliers;
+    spent = 0;
+    for (uint8_t i = 0; i != gSio.txCount; ++i) {
+      if (gSio.txNs[i] > gSio.runStartNs) {
+        gSio.txNs[i] = gSio.runStartNs;
+      }
+    }
+  }
+  gCore0Free = gSio.runStartNs + (uint64_t)(spent * gOpt.scale);
+  gStats.core0Host += spent;
+  ++gStats.core0Runs;
+}
+
+static void core0IdleMeasure() {
+  gClockNs = UINT64_MAX;
+  for (uint32_t i = 0; i != 1000; ++i) {
+    const uint64_t t = hostNs();
+    const uint64_t spent = hostNs() - t;
+    gClockNs = spent < gClockNs ? spent : gClockNs;
+  }
+  gSimAtt = true;
+  const uint64_t host = hostNs();
+  for (uint32_t i = 0; i != SIM_IDLE_PASSES; ++i) {
+    SM_task();
+  }
+  const double pass = (double)(hostNs() - host) / SIM_IDLE_PASSES;
+  gStats.idleNs = (uint64_t)(pass * gOpt.scale) + 1;
+}
+
+// -l: the last runs of core1 in virtual time, each holding the mutex
+#define SIM_BUSY_RUNS 16
+
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+} SimBusy;
+
+static SimBusy gBusy[SIM_BUSY_RUNS];
+static uint32_t gBusyNext = 0;
+static Hist gLockWait = {.shift = 2};
+
+static void core1Busy(uint64_t start, uint64_t spent) {
+  SimBusy *b = gBusy + gBusyNext++ % SIM_BUSY_RUNS;
+  b->start = start;
+  b->end = start + (uint64_t)(spent * gOpt.scale);
+}
+
+// when core0, asking for the mutex at `at`, gets it
+static uint64_t lockTake(uint64_t at) {
+  const uint64_t asked = at;
+  for (bool moved = true; moved;) {
+    moved = false;
+    for (uint32_t i = 0; i != SIM_BUSY_RUNS; ++i) {
+      if (at >= gBusy[i].start && at < gBusy[i].end) {
+        at = gBusy[i].end;
+        moved = true;
+      }
+    }
+  }
+  histAdd(&gLockWait, (at - asked) / 1000);
+  return at;
+}
+
+// core1 loop pass after a USB event
+static void usbRun(const SimUsbEvent *e) {
+  gSimNs = e->ns;
+  const uint64_t host = hostNs();
+  switch (e->type) {
+  case SIM_MOUNT:
+    if (e->instance < 16) {
+      gSimProtocol[e->addr][e->instance] = e->protocol;
+      gSimArmed[e->addr][e->instance] = false;
+    }
+    gSimVid[e->addr] = e->vid;
+    gSimPid[e->addr] = e->pid;
+    tuh_hid_mount_cb(e->addr, e->instance, e->data, e->len);
+    break;
+  case SIM_UMOUNT:
+    if (e->instance < 16) {
+      gSimArmed[e->addr][e->instance] = false;
+    }
+    tuh_hid_umount_cb(e->addr, e->instance);
+    break;
+  case SIM_REPORT:
+    tuh_hid_report_received_cb(e->addr, e->instance, e->data, e->len);
+    break;
+  }
+  if (gSimSetProtocol.pending) {
+    gSimSetProtocol.pending = false;
+    tuh_hid_set_protocol_complete_cb(gSimSetProtocol.addr, gSimSetProtocol.idx,
+                                     gSimSetProtocol.protocol);
+  }
+  frameRefresh();
+  const uint64_t spent = hostNs() - host;
+  if (spent > SIM_HOST_OUTLIER_NS) {
+    ++gStats.hostOutliers;
+  } else {
+    core1Busy(e->ns, spent);
+    gStats.core1Host += spent;
+    ++gStats.core1Runs;
+    if (e->type == SIM_REPORT) {
+      gStats.reportHost += spent;
+      ++gStats.reportRuns;
+      if (spent > gStats.reportMaxNs) {
+        gStats.reportMaxNs = spent;
+      }
+    }
+  }
+  profileTask();
+}
+
+// the -n mouse is polled at virtual time at
+static void moverRun(uint64_t at) {
+  const uint32_t pending = moverCounts(at) - gMover.sent;
+  if (!pending) {
+    gMover.pollNs += gMover.intervalNs; // NAK
+    return;
+  }
+  const uint8_t dx = pending > 127 ? 127 : pending;
+  uint8_t m[4] = {0, dx, 0, 0};
+  gMover.sent += dx;
+  gMover.armed = false;
+  const SimUsbEvent e = {at, SIM_REPORT, MOVER_ADDR, 0, 0, 0, 0, 4, m};
+  usbRun(&e);
+}
+
+// a recorded event: reports wait until their interface is armed
+static void usbReplay(uint32_t i) {
+  const SimUsbEvent *e = gUsb + i;
+  const int held = heldFind(e->addr, e->instance);
+  if (e->type != SIM_REPORT) {
+    if (held >= 0) {
+      ++gSimLost; // gone with the device
+      heldDrop(held);
+    }
+    usbRun(e);
+    return;
+  }
+  ++gSimReports;
+  if (e->instance < 16 && gSimArmed[e->addr][e->instance]) {
+    gSimArmed[e->addr][e->instance] = false;
+    usbRun(e);
+  } else if (held >= 0) {
+    ++gSimLost;
+    gSimHeld[held].event = i;
+  } else if (gSimHeldCount != SIM_HELD_MAX) {
+    gSimHeld[gSimHeldCount++] = (SimHeld){e->addr, e->instance, i};
+  } else {
+    ++gSimLost;
+  }
+}
+
+// held reports whose interface has been armed since, sent at time at
+static void heldRun(uint64_t at) {
+  for (uint32_t i = 0; i < gSimHeldCount;) {
+    const SimHeld h = gSimHeld[i];
+    if (h.instance < 16 && gSimArmed[h.addr][h.instance]) {
+      heldDrop(i);
+      gSimArmed[h.addr][h.instance] = false;
+      ++gSimWaited;
+      SimUsbEvent e = gUsb[h.event];
+      e.ns = at;
+      usbRun(&e);
+    } else {
+      ++i;
+    }
+  }
+}
+
+// replay the USB events up to virtual time t, with core1 loop passes between
+static void usbUntil(uint64_t t) {
+  static uint64_t pass = 0;
+  while (true) {
+    const uint64_t usb = gUsbNext != gUsbCount ? gUsb[gUsbNext].ns : UINT64_MAX;
+    const uint64_t mover = gMover.armed ? gMover.pollNs : UINT64_MAX;
+    if (usb <= t && usb <= mover && usb <= pass) {
+      usbReplay(gUsbNext++);
+    } else if (mover <= t && mover <= pass) {
+      moverRun(mover);
+    } else if (pass <= t) {
+      heldRun(pass);
+      gSimNs = pass;
+      const uint64_t host = hostNs();
+      core1Pass();
+      const uint64_t spent = hostNs() - host;
+      if (spent <= SIM_HOST_OUTLIER_NS) {
+        core1Busy(pass, spent);
+        gStats.passHost += spent;
+        ++gStats.passRuns;
+        gStats.passMaxNs = spent > gStats.passMaxNs ? spent : gStats.passMaxNs;
+      }
+      pass += SIM_CORE1_PASS_NS;
+    } else {
+      break;
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// Console
+//--------------------------------------------------------------------+
+
+static void printPoll(uint64_t ns, const uint8_t *data, uint32_t len) {
+  printf("{\"event\":\"poll\",\"timestamp\":\"%llu\",\"data\":\"",
+         (unsigned long long)(ns / 1000));
+  for (uint32_t i = 0; i != len; ++i) {
+    printf(i ? " %02x" : "%02x", data[i]);
+  }
+  printf("\"},\n");
+}
+
+// the motion in a mouse reply: how old its counts were at poll start t. The
+// firmware's total of counts sent tells which they were; those of a reply cut
+// short are gone and not counted.
+static void motionAccount(uint64_t t, const uint8_t *reply, uint32_t len) {
+  if (len < 5 || reply[0] != 0x12) {
+    return;
+  }
+  const int8_t dx = reply[4];
+  const uint32_t newest = gSentX[gMouseSlot];
+  for (int8_t i = 0; i < dx; ++i) {
+    const uint64_t moved = gMover.mountNs + (newest - i) * MOVER_FRAME_NS;
+    const uint32_t age = (t - moved) / 1000;
+    histAdd(&gStats.motionAge, age);
+    gStats.motionAgeSum += age;
+  }
+  if (dx > 0) {
+    gStats.motionFreshSum += (t - gMover.mountNs) / 1000 - newest * 1000;
+    ++gStats.motionPolls;
+  }
+}
+
+// the motion core0 committed in a poll, where the reply carried the slot's
+// mouse; base holds gSentX and gSentY from before the poll
+static void motionCommitted(const uint32_t base[2][PAD_SLOTS],
+                            const uint8_t *reply, uint32_t len) {
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    // without multitap only the slot served moves
+    const uint32_t i = reply[0] == 0x80 ? 2 + s * SLOT_SIZE : 0;
+    if (len > i && reply[i] == 0x12) {
+      gStats.sentX[s] += (int32_t)(gSentX[s] - base[0][s]);
+      gStats.sentY[s] += (int32_t)(gSentY[s] - base[1][s]);
+    }
+  }
+}
+
+// one transaction starting at t, returns the time ATT went up again
+static uint64_t consolePoll(uint64_t t) {
+  const uint64_t bitNs = 1000000u / gOpt.khz;
+  const uint64_t loopNs = 8 * SIM_SIO_CYCLE_NS; // a psx_sio loop pass
+  const uint64_t ackTimeoutNs = gOpt.ackTimeoutUs * 1000ull;
+
+  uint8_t cmd[SIM_CMD_SIZE] = {0x01, 0x42, gOpt.tap ? 0x01 : 0x00};
+  uint8_t reply[SIM_CMD_SIZE];
+  uint32_t replyLen = 0;
+
+  usbUntil(t);
+  uint32_t base[2][PAD_SLOTS];
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    base[0][s] = gSentX[s];
+    base[1][s] = gSentY[s];
+  }
+  gSimAtt = false;
+  uint64_t at = t + SIM_ATT_LEAD_NS;
+  sioClock(cmd[0], at, bitNs);
+  core0Run(t);
+  ++gStats.polls;
+
+  uint32_t word = 0;
+  uint64_t queued;
+  bool dat = sioPull(&word, &queued); // response for byte 0
+  uint32_t delay = sioFirstDelay(word);
+  uint64_t end = at;
+  const uint32_t bytes =
+      gOpt.cutBytes && (gStats.polls & 1) ? gOpt.cutBytes : SIM_CMD_SIZE;
+  for (uint32_t i = 0; i < bytes && dat; ++i) {
+    end = at + 8 * bitNs;
+    if (i != 0) {
+      reply[replyLen++] = sioVerdictNext(word);
+      sioClock(cmd[i], at, bitNs);
+    }
+    const uint64_t sampled = end - bitNs / 2; // the last rising CLK edge
+    const uint64_t pushed = sioPushed();
+    usbUntil(pushed);
+    if (gSio.clocking) {
+      core0Run(pushed); // else core0 took it while watching CLK
+    }
+    dat = sioPull(&word, &queued);
+    if (dat && i == 0 && gOpt.mutex) {
+      // the verdict waited for core1, and so did everything after it
+      usbUntil(queued);
+      const uint64_t wait = lockTake(queued) - queued;
+      queued += wait;
+      gCore0Free += wait;
+      for (uint8_t k = 0; k != gSio.txCount; ++k) {
+        gSio.txNs[k] += wait;
+      }
+    }
+    if (!dat || !sioVerdictAck(word)) {
+      break; // no ACK: the reply is over
+    }
+    // psx_sio pulls the verdict when the ACK delay has run out
+    const uint64_t due = sampled + SIM_SIO_LOOP_CYCLES * SIM_SIO_CYCLE_NS +
+                         delay * loopNs;
+    const int64_t margin = (int64_t)(due - queued);
+    histAdd(&gStats.reaction, (queued - pushed) / 1000);
+    if (margin < 0) {
+      ++gStats.lateAcks;
+    } else {
+      histAdd(&gStats.margin, margin / 1000);
+    }
+    if (margin < gStats.marginMinNs) {
+      gStats.marginMinNs = margin;
+    }
+    const uint64_t ack = (margin < 0 ? queued : due) +
+                         SIM_SIO_ACK_CYCLES * SIM_SIO_CYCLE_NS;
+    if (ack > end + ackTimeoutNs) {
+      ++gStats.lost;
+      break;
+    }
+    ++gStats.bytes;
+    at = ack + (sioVerdictWidth(word) + 1) * loopNs + SIM_SIO_CYCLE_NS +
+         gOpt.gapUs * 1000ull;
+    delay = sioVerdictDelay(word);
+  }
+
+  const uint64_t rise = end + SIM_ATT_TRAIL_NS;
+  usbUntil(rise);
+  gSio.clocking = false;
+  gSimAtt = true;
+  core0Run(rise);
+  if (replyLen) {
+    motionCommitted(base, reply, replyLen);
+  }
+  // core1 rebuilds the frame once it sees the poll went out
+  gSimNs = rise;
+  frameRefresh();
+  profileTask();
+  if (gOpt.moverHz) {
+    motionAccount(t, reply, replyLen);
+  }
+  if (gOpt.verbose) {
+    printPoll(t, reply, replyLen);
+  }
+  return rise;
+}
+
+//--------------------------------------------------------------------+
+// Main
+//--------------------------------------------------------------------+
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+// the profile store as psxprofile writes it, device cache included
+static int flashSave(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return 1;
+  }
+  const uint32_t blocks = PROFILE_SECTORS * FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+  for (uint32_t i = 0; i != blocks; ++i) {
+    const uint32_t offset = PROFILE_OFFSET + i * FLASH_PAGE_SIZE;
+    uint8_t b[512];
+    memset(b, 0, sizeof(b));
+    put32(b, 0x0A324655);
+    put32(b + 4, 0x9E5D5157);
+    put32(b + 8, 0x2000); // family ID present
+    put32(b + 12, 0x10000000 + offset);
+    put32(b + 16, FLASH_PAGE_SIZE);
+    put32(b + 20, i);
+    put32(b + 24, blocks);
+    put32(b + 28, 0xe48bff56); // RP2040
+    memcpy(b + 32, gSimFlash + offset, FLASH_PAGE_SIZE);
+    put32(b + 508, 0x0AB16F30);
+    fwrite(b, 1, sizeof(b), f);
+  }
+  return fclose(f) != 0;
+}
+
+static int flashLoad(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return 1;
+  }
+  uint8_t b[512];
+  while (fread(b, 1, sizeof(b), f) == sizeof(b)) {
+    const uint32_t addr = le32(b + 12) - 0x10000000;
+    const uint32_t size = le32(b + 16);
+    if (le32(b) == 0x0A324655 && le32(b + 4) == 0x9E5D5157 && size <= 476 &&
+        addr < sizeof(gSimFlash) && size <= sizeof(gSimFlash) - addr) {
+      memcpy(gSimFlash + addr, b + 32, size);
+    }
+  }
+  fclose(f);
+  return 0;
+}
+
+static volatile uint32_t gLookupHits; // keeps the lookups
+
+// findDev() on every (dev_addr, instance), mounted or not
+static void lookupMeasure() {
+  const uint32_t rounds = 1 << 20;
+  uint32_t hits = 0;
+  const uint64_t host = hostNs();
+  for (uint32_t i = 0; i != rounds; ++i) {
+    hits += findDev(i % DEV_ADDRS, (i / DEV_ADDRS) % CFG_TUH_HID) != NULL;
+  }
+  gStats.lookupNs = (double)(hostNs() - host) / rounds;
+  gLookupHits = hits;
+}
+
+static volatile int32_t gMotionSum; // keeps the motion
+
+// motionApply() with the active profile on a mouse changing speed every report
+static void motionMeasure() {
+  const uint32_t rounds = 1 << 20;
+  MotionAxis ax[2] = {0};
+  int32_t sum = 0;
+  const uint64_t host = hostNs();
+  for (uint32_t i = 0; i != rounds; ++i) {
+    const int16_t d[2] = {(i & 63) - 31, (i >> 6 & 15) - 7};
+    int32_t out[2];
+    motionApply(&gMotion, ax, d, 1000, out);
+    sum += out[0] + out[1];
+  }
+  gStats.motionNs = (double)(hostNs() - host) / rounds;
+  gMotionSum = sum;
+}
+
+static void simPrint() {
+  const SimStats *st = &gStats;
+  printf("{\"event\":\"sim\",\"timestamp\":\"%llu\",\"polls\":\"%lu\","
+         "\"bytes\":\"%lu\",\"late_acks\":\"%lu\",\"lost\":\"%lu\","
+         "\"ack_margin_min_us\":\"%.2f\",\"idle_pass_us\":\"%.3f\"",
+         (unsigned long long)(gSimNs / 1000), (unsigned long)st->polls,
+         (unsigned long)st->bytes, (unsigned long)st->lateAcks,
+         (unsigned long)st->lost,
+         st->marginMinNs == INT64_MAX ? 0 : st->marginMinNs / 1000.,
+         st->idleNs / 1000.);
+  histPrint("reaction", &st->reaction);
+  histPrint("ack_margin", &st->margin);
+  if (gOpt.mutex) {
+    histPrint("mutex_wait", &gLockWait);
+  }
+  printf(",\"sent_x\":\"%ld %ld %ld %ld\",\"sent_y\":\"%ld %ld %ld %ld\"",
+         (long)st->sentX[0], (long)st->sentX[1], (long)st->sentX[2],
+         (long)st->sentX[3], (long)st->sentY[0], (long)st->sentY[1],
+         (long)st->sentY[2], (long)st->sentY[3]);
+  if (gOpt.moverHz) {
+    histPrint("motion_age", &st->motionAge);
+    printf(",\"motion_age_mean_us\":\"%.0f\","
+           "\"motion_fresh_mean_us\":\"%.0f\"",
+           st->motionAge.count ? (double)st->motionAgeSum / st->motionAge.count
+                               : 0,
+           st->motionPolls ? (double)st->motionFreshSum / st->motionPolls : 0);
+  }
+  printf(",\"usb_reports\":\"%lu\",\"usb_waited\":\"%lu\","
+         "\"usb_lost\":\"%lu\"",
+         (unsigned long)gSimReports, (unsigned long)gSimWaited,
+         (unsigned long)(gSimLost + gSimHeldCount));
+  printf(",\"profile_active\":\"%u\",\"profile_pending\":\"%02x\","
+         "\"flash_erases\":\"%lu\",\"flash_programs\":\"%lu\"",
+         gProfileStore.active, gProfileStore.dirty, (unsigned long)gSimErases,
+         (unsigned long)gSimPrograms);
+  printf(",\"core0_host_ns\":\"%.1f\",\"core1_host_ns\":\"%.1f\","
+         "\"report_host_ns\":\"%.1f\",\"report_host_max_ns\":\"%llu\","
+         "\"report_rp2040_us\":\"%.2f\","
+         "\"lookup_host_ns\":\"%.2f\",\"motion_host_ns\":\"%.2f\","
+         "\"core1_pass_ns\":\"%.1f\",\"core1_pass_max_ns\":\"%llu\","
+         "\"core1_load\":\"%.4f\",\"host_outliers\":\"%lu\"},\n",
+         st->core0Runs ? (double)st->core0Host / st->core0Runs : 0,
+         st->core1Runs ? (double)st->core1Host / st->core1Runs : 0,
+         st->reportRuns ? (double)st->reportHost / st->reportRuns : 0,
+         (unsigned long long)st->reportMaxNs,
+         st->reportRuns
+             ? st->reportHost * gOpt.scale / st->reportRuns / 1000
+             : 0,
+         st->lookupNs, st->motionNs,
+         st->passRuns ? (double)st->passHost / st->passRuns : 0,
+         (unsigned long long)st->passMaxNs,
+         gSimNs ? st->core1Host * gOpt.scale / gSimNs : 0,
+         (unsigned long)st->hostOutliers);
+}
+
+static int usage() {
+  fprintf(stderr, "usage: psxsim [-c khz] [-r hz] [-g us] [-a us] [-m] "
+                  "[-x n] [-d ms] [-s x] [-t s] [-p n | -k n | -n hz] "
+                  "[-b] [-w] [-l] [-f uf2] [-o uf2] [-v] [usb.jsonl]\n");
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  const char *flashPath = NULL;
+  const char *savePath = NULL;
+  uint32_t synth = 0;
+  uint32_t mice = 0;
+  const char *usbPath = NULL;
+  for (int i = 1; i < argc; ++i) {
+    const char *a = argv[i];
+    const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (a[0] != '-') {
+      usbPath = a;
+      continue;
+    }
+    if (strcmp(a, "-m") == 0) {
+      gOpt.tap = true;
+      continue;
+    } else if (strcmp(a, "-v") == 0) {
+      gOpt.verbose = true;
+      continue;
+    } else if (strcmp(a, "-b") == 0) {
+      gOpt.bootRefused = true;
+      continue;
+    } else if (strcmp(a, "-w") == 0) {
+      gPollAlign = true;
+      continue;
+    } else if (strcmp(a, "-l") == 0) {
+      gOpt.mutex = true;
+      continue;
+    } else if (!v) {
+      return usage();
+    } else if (strcmp(a, "-c") == 0) {
+      gOpt.khz = atoi(v);
+    } else if (strcmp(a, "-r") == 0) {
+      gOpt.pollHz = atof(v);
+    } else if (strcmp(a, "-g") == 0) {
+      gOpt.gapUs = atoi(v);
+    } else if (strcmp(a, "-x") == 0) {
+      gOpt.cutBytes = atoi(v);
+    } else if (strcmp(a, "-d") == 0) {
+      gOpt.pauseMs = atoi(v);
+    } else if (strcmp(a, "-a") == 0) {
+      gOpt.ackTimeoutUs = atoi(v);
+    } else if (strcmp(a, "-s") == 0) {
+      gOpt.scale = atof(v);
+    } else if (strcmp(a, "-t") == 0) {
+      gOpt.seconds = atof(v);
+    } else if (strcmp(a, "-f") == 0) {
+      flashPath = v;
+    } else if (strcmp(a, "-o") == 0) {
+      savePath = v;
+    } else if (strcmp(a, "-p") == 0) {
+      synth = atoi(v);
+    } else if (strcmp(a, "-k") == 0) {
+      mice = atoi(v);
+    } else if (strcmp(a, "-n") == 0) {
+      gOpt.moverHz = atoi(v);
+    } else {
+      return usage();
+    }
+    ++i;
+  }
+  if (gOpt.khz == 0 || gOpt.khz > 1000000 || gOpt.pollHz < 0 ||
+      (gOpt.moverHz && (synth || mice || gOpt.tap)) || (synth && mice) ||
+      mice > DEV_ADDRS - 2) {
+    return usage();
+  }
+
+  memset(gSimFlash, 0xff, sizeof(gSimFlash));
+  if (flashPath && flashLoad(flashPath)) {
+    fprintf(stderr, "psxsim: cannot read %s\n", flashPath);
+    return 1;
+  }
+  if (gOpt.moverHz) {
+    moverMount(gOpt.moverHz);
+  } else if (synth) {
+    usbSynth(synth);
+  } else if (mice) {
+    usbMice(mice, gOpt.seconds ? (uint64_t)(gOpt.seconds * 1e9)
+                               : 10000000000u);
+  } else if (usbPath) {
+    FILE *f = fopen(usbPath, "r");
+    if (!f) {
+      fprintf(stderr, "psxsim: cannot read %s\n", usbPath);
+      return 1;
+    }
+    usbLoad(f);
+    fclose(f);
+  }
+  uint64_t endNs = (uint64_t)(gOpt.seconds * 1e9);
+  if (endNs == 0) {
+    endNs = gUsbCount ? gUsb[gUsbCount - 1].ns + 1000000000u : 10000000000u;
+  }
+
+  // what core1_main() and main() do before their loops
+  profilesInit();
+  framePublish();
+  SIO_init();
+  SM_init();
+  profilesLoad();
+  deviceExpect();
+  framePublish();
+  ledInit();
+  core0IdleMeasure();
+
+  const uint64_t periodNs = gOpt.pollHz ? (uint64_t)(1e9 / gOpt.pollHz) : 0;
+  const uint64_t pauseNs = gOpt.pauseMs * 1000000ull;
+  uint64_t next = periodNs;
+  while (next < endNs) {
+    if (next % 1000000000u < pauseNs) {
+      next = periodNs ? next + periodNs : next - next % 1000000000u + pauseNs;
+      continue;
+    }
+    const uint64_t rise = consolePoll(next);
+    next = periodNs ? next + periodNs : rise + SIM_ATT_TRAIL_NS;
+    if (next < rise) {
+      next = rise + SIM_ATT_TRAIL_NS; // the console is not that fast
+    }
+  }
+  usbUntil(endNs);
+  gSimNs = endNs;
+
+  lookupMeasure();
+  motionMeasure();
+  latencyPrint();
+  simPrint();
+  if (savePath && flashSave(savePath)) {
+    fprintf(stderr, "psxsim: cannot write %s\n", savePath);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,206 @@
+// Converter for the binary event trace (DEBUG_TRACE in usb-ps1-adapter.c).
+//
+// Build: cc -O2 -o psxtrace psxtrace.c
+// Usage: psxtrace < serial.bin
+//
+// Turns the trace records in the adapter's UART output back into the JSON
+// lines the adapter used to print itself. Text between records is copied
+// through unchanged.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// must match trace.h
+#define TRACE_MAGIC 0xa5
+#define TRACE_RECORD 32
+#define TRACE_EV_DATA 10
+#define TRACE_MORE_DATA 28
+
+#define TRACE_MORE 0
+#define TRACE_MOUNT 1
+#define TRACE_UMOUNT 2
+#define TRACE_REPORT 3
+#define TRACE_PARSE_FAIL 4
+#define TRACE_POLL 5
+#define TRACE_POLL_IGNORED 6
+#define TRACE_LOST 7
+
+#define TRACE_F_NO_REQUEST 1
+#define TRACE_F_DESCR 2
+
+#define MAX_PAYLOAD 0x10000
+
+typedef struct {
+  uint8_t type;
+  uint8_t addr;
+  uint8_t instance;
+  uint8_t param;
+  uint8_t flags;
+  uint64_t us;
+  uint16_t len;
+  uint16_t arg[2];
+  uint32_t have; // payload bytes received so far
+  uint8_t data[MAX_PAYLOAD];
+} Event;
+
+static Event gEv;
+static int gEvOpen = 0;
+
+static uint16_t le16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static const char *protocolName(uint8_t protocol) {
+  static const char *names[] = {"None", "Keyboard", "Mouse"};
+  return protocol < 3 ? names[protocol] : "Unknown";
+}
+
+static void printData(const uint8_t *data, uint32_t len) {
+  printf("\"data\":\"");
+  for (uint32_t i = 0; i != len; ++i) {
+    printf(i ? " %02x" : "%02x", data[i]);
+  }
+  printf("\"");
+}
+
+static void printEvent(const Event *e) {
+  const unsigned long long ts = e->us;
+  const char *noRequest = ",\"error\":\"cannot request report\"";
+  switch (e->type) {
+  case TRACE_MOUNT:
+    printf("{\"event\":\"mount\",\"timestamp\":\"%llu\",\"vid\":\"%04x\","
+           "\"pid\":\"%04x\",\"address\":\"%u\",\"instance\":\"%u\","
+           "\"protocol\":\"%s\",",
+           ts, e->arg[0], e->arg[1], e->addr, e->instance,
+           protocolName(e->param));
+    printData(e->data, e->have);
+    printf("%s},\n", e->flags & TRACE_F_NO_REQUEST ? noRequest : "");
+    break;
+  case TRACE_UMOUNT:
+    printf("{\"event\":\"umount\",\"timestamp\":\"%llu\",\"address\":\"%u\","
+           "\"instance\":\"%u\"},\n",
+           ts, e->addr, e->instance);
+    break;
+  case TRACE_REPORT:
+    printf("{\"event\":\"report\",\"timestamp\":\"%llu\",\"address\":\"%u\","
+           "\"instance\":\"%u\",",
+           ts, e->addr, e->instance);
+    printData(e->data, e->have);
+    printf("%s},\n", e->flags & TRACE_F_NO_REQUEST ? noRequest : "");
+    break;
+  case TRACE_PARSE_FAIL:
+    printf("{\"event\":\"parse_error\",\"timestamp\":\"%llu\",\"address\":"
+           "\"%u\",\"instance\":\"%u\",\"protocol\":\"%s\",\"what\":\"%s\"},\n",
+           ts, e->addr, e->instance, protocolName(e->param),
+           e->flags & TRACE_F_DESCR ? "descriptor" : "report");
+    break;
+  case TRACE_POLL:
+    printf("{\"event\":\"poll\",\"timestamp\":\"%llu\",", ts);
+    printData(e->data, e->have);
+    printf("},\n");
+    break;
+  case TRACE_POLL_IGNORED:
+    printf("{\"event\":\"poll_ignored\",\"timestamp\":\"%llu\",\"index\":"
+           "\"%u\",\"command\":\"%02x\"},\n",
+           ts, e->arg[0], e->param);
+    break;
+  case TRACE_LOST:
+    printf("{\"event\":\"trace_lost\",\"timestamp\":\"%llu\",\"core\":\"%u\","
+           "\"count\":\"%u\"},\n",
+           ts, e->param, e->arg[0]);
+    break;
+  default:
+    printf("{\"event\":\"trace_unknown\",\"timestamp\":\"%llu\",\"type\":"
+           "\"%u\"},\n",
+           ts, e->type);
+    break;
+  }
+}
+
+static void flushEvent() {
+  if (gEvOpen) {
+    if (gEv.have != gEv.len) {
+      fprintf(stderr, "psxtrace: event at %llu truncated (%u of %u bytes)\n",
+              (unsigned long long)gEv.us, gEv.have, gEv.len);
+    }
+    printEvent(&gEv);
+    gEvOpen = 0;
+  }
+}
+
+static void addPayload(const uint8_t *data, uint8_t size, uint8_t max) {
+  if (size > max) {
+    size = max;
+  }
+  if (gEv.have + size > MAX_PAYLOAD) {
+    size = MAX_PAYLOAD - gEv.have;
+  }
+  memcpy(gEv.data + gEv.have, data, size);
+  gEv.have += size;
+}
+
+static void record(const uint8_t *r) {
+  const uint8_t type = r[2];
+  const uint8_t size = r[3];
+  if (type == TRACE_MORE) {
+    if (!gEvOpen) {
+      fprintf(stderr, "psxtrace: continuation without event\n");
+      return;
+    }
+    addPayload(r + 4, size, TRACE_MORE_DATA);
+  } else {
+    flushEvent();
+    gEv.type = type;
+    gEv.addr = r[4];
+    gEv.instance = r[5];
+    gEv.param = r[6];
+    gEv.flags = r[7];
+    gEv.us = le32(r + 8) | (uint64_t)le32(r + 12) << 32;
+    gEv.len = le16(r + 16);
+    gEv.arg[0] = le16(r + 18);
+    gEv.arg[1] = le16(r + 20);
+    gEv.have = 0;
+    gEvOpen = 1;
+    addPayload(r + 22, size, TRACE_EV_DATA);
+  }
+  if (gEv.have >= gEv.len) {
+    flushEvent();
+  }
+}
+
+int main(void) {
+  uint8_t buf[TRACE_RECORD];
+  size_t n = 0;
+  int c;
+  while ((c = getchar()) != EOF) {
+    buf[n++] = (uint8_t)c;
+    while (n) {
+      if (buf[0] != TRACE_MAGIC) {
+        // text printed between records
+        putchar(buf[0]);
+        memmove(buf, buf + 1, --n);
+        continue;
+      }
+      if (n < TRACE_RECORD) {
+        break;
+      }
+      uint8_t sum = 0;
+      for (int i = 0; i != TRACE_RECORD; ++i) {
+        sum += buf[i];
+      }
+      if (sum != 0) {
+        putchar(buf[0]); // not a record after all
+        memmove(buf, buf + 1, --n);
+        continue;
+      }
+      record(buf);
+      n = 0;
+    }
+  }
+  flushEvent();
+  fwrite(buf, 1, n, stdout);
+  return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef SIMSDK_HARDWARE_CLOCKS_H
+#define SIMSDK_HARDWARE_CLOCKS_H
+
+#include "pico/stdlib.h"
+
+enum clock_index { clk_sys = 5 };
+
+static inline uint32_t clock_get_hz(enum clock_index clk) {
+  (void)clk;
+  return 120000000;
+}
+
+#endif // SIMSDK_HARDWARE_CLOCKS_H
@@ -0,0 +1,58 @@
+#ifndef SIMSDK_HARDWARE_DMA_H
+#define SIMSDK_HARDWARE_DMA_H
+
+#include "pico/stdlib.h"
+
+// The one DMA channel feeds the status LED, which the simulation has not got:
+// transfers finish at once and go nowhere.
+
+typedef struct {
+  uint32_t unused;
+} dma_channel_config;
+
+enum dma_channel_transfer_size { DMA_SIZE_8, DMA_SIZE_16, DMA_SIZE_32 };
+
+static inline int dma_claim_unused_channel(bool required) {
+  (void)required;
+  return 0;
+}
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+  (void)channel;
+  dma_channel_config c = {0};
+  return c;
+}
+
+static inline void simDmaNop(const void *first, ...) { (void)first; }
+#define channel_config_set_transfer_data_size(...) simDmaNop(__VA_ARGS__)
+#define channel_config_set_read_increment(...) simDmaNop(__VA_ARGS__)
+#define channel_config_set_write_increment(...) simDmaNop(__VA_ARGS__)
+#define channel_config_set_dreq(...) simDmaNop(__VA_ARGS__)
+
+static inline void dma_channel_configure(uint channel,
+                                         const dma_channel_config *config,
+                                         volatile void *write_addr,
+                                         const volatile void *read_addr,
+                                         uint transfer_count, bool trigger) {
+  (void)channel;
+  (void)config;
+  (void)write_addr;
+  (void)read_addr;
+  (void)transfer_count;
+  (void)trigger;
+}
+
+static inline bool dma_channel_is_busy(uint channel) {
+  (void)channel;
+  return false;
+}
+
+static inline void dma_channel_set_read_addr(uint channel,
+                                             const volatile void *read_addr,
+                                             bool trigger) {
+  (void)channel;
+  (void)read_addr;
+  (void)trigger;
+}
+
+#endif // SIMSDK_HARDWARE_DMA_H
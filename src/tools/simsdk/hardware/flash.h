@@ -0,0 +1,17 @@
+#ifndef SIMSDK_HARDWARE_FLASH_H
+#define SIMSDK_HARDWARE_FLASH_H
+
+#include "pico/stdlib.h"
+
+#define FLASH_PAGE_SIZE 256
+#define FLASH_SECTOR_SIZE 4096
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+// the flash is an array, XIP reads go straight to it
+extern uint8_t gSimFlash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE gSimFlash
+
+void flash_range_erase(uint32_t offset, size_t count);
+void flash_range_program(uint32_t offset, const uint8_t *data, size_t count);
+
+#endif // SIMSDK_HARDWARE_FLASH_H
@@ -0,0 +1,79 @@
+#ifndef SIMSDK_HARDWARE_PIO_H
+#define SIMSDK_HARDWARE_PIO_H
+
+#include "pico/stdlib.h"
+
+// Configuration calls do nothing. The FIFO calls go to the bus model of the
+// psx_sio state machine in psxsim.c, the only one the simulation claims. The
+// instruction encoders are the SDK's, siopio executes what they return.
+
+struct pio_hw {
+  uint32_t txf[4]; // written by DMA only
+};
+
+typedef struct pio_hw *PIO;
+
+typedef struct {
+  uint32_t unused;
+} pio_sm_config;
+
+struct pio_program {
+  const uint16_t *instructions;
+  uint8_t length;
+  int8_t origin;
+  uint8_t pio_version;
+};
+
+enum pio_fifo_join { PIO_FIFO_JOIN_NONE, PIO_FIFO_JOIN_TX, PIO_FIFO_JOIN_RX };
+
+static inline pio_sm_config pio_get_default_sm_config(void) {
+  pio_sm_config c = {0};
+  return c;
+}
+
+static inline void simPioNop(const void *first, ...) { (void)first; }
+#define sm_config_set_wrap(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_sideset(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_sideset_pins(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_in_pins(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_out_pins(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_set_pins(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_in_shift(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_out_shift(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_fifo_join(...) simPioNop(__VA_ARGS__)
+#define sm_config_set_clkdiv(...) simPioNop(__VA_ARGS__)
+#define pio_gpio_init(...) simPioNop(__VA_ARGS__)
+#define pio_sm_set_consecutive_pindirs(...) simPioNop(__VA_ARGS__)
+#define pio_sm_set_pins_with_mask(...) simPioNop(__VA_ARGS__)
+#define pio_sm_set_pindirs_with_mask(...) simPioNop(__VA_ARGS__)
+#define pio_sm_init(...) simPioNop(__VA_ARGS__)
+#define pio_sm_set_enabled(...) simPioNop(__VA_ARGS__)
+#define pio_sm_restart(...) simPioNop(__VA_ARGS__)
+#define pio_sm_exec(...) simPioNop(__VA_ARGS__)
+enum pio_src_dest { pio_pins, pio_x, pio_y, pio_null, pio_pindirs };
+
+static inline uint pio_encode_jmp(uint addr) { return addr; }
+static inline uint pio_encode_set(enum pio_src_dest dest, uint value) {
+  return 0xE000u | dest << 5 | value;
+}
+static inline uint pio_encode_sideset_opt(uint bit_count, uint value) {
+  return 0x1000u | value << (12u - bit_count);
+}
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+  (void)pio;
+  (void)sm;
+  (void)is_tx;
+  return 0;
+}
+
+bool pio_claim_free_sm_and_add_program_for_gpio_range(
+    const struct pio_program *program, PIO *pio, uint *sm, uint *offset,
+    uint gpio_base, uint gpio_count, bool set_gpio_base);
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+
+#endif // SIMSDK_HARDWARE_PIO_H
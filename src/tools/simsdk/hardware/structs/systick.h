@@ -0,0 +1,17 @@
+#ifndef SIMSDK_HARDWARE_STRUCTS_SYSTICK_H
+#define SIMSDK_HARDWARE_STRUCTS_SYSTICK_H
+
+#include <stdint.h>
+
+// only with DEBUG_STDOUT or PSX_CAPTURE, which psxsim leaves off
+typedef struct {
+  volatile uint32_t csr;
+  volatile uint32_t rvr;
+  volatile uint32_t cvr;
+  volatile uint32_t calib;
+} systick_hw_t;
+
+static systick_hw_t gSimSystick __attribute__((unused));
+#define systick_hw (&gSimSystick)
+
+#endif // SIMSDK_HARDWARE_STRUCTS_SYSTICK_H
@@ -0,0 +1,8 @@
+#ifndef SIMSDK_HARDWARE_SYNC_H
+#define SIMSDK_HARDWARE_SYNC_H
+
+#include "pico/stdlib.h"
+
+#define __dmb() __sync_synchronize()
+
+#endif // SIMSDK_HARDWARE_SYNC_H
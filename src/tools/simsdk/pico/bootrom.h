@@ -0,0 +1,4 @@
+#ifndef SIMSDK_PICO_BOOTROM_H
+#define SIMSDK_PICO_BOOTROM_H
+
+#endif // SIMSDK_PICO_BOOTROM_H
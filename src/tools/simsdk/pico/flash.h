@@ -0,0 +1,16 @@
+#ifndef SIMSDK_PICO_FLASH_H
+#define SIMSDK_PICO_FLASH_H
+
+#include "pico/stdlib.h"
+
+// the other core is not running anything on its own, call straight away
+static inline int flash_safe_execute(void (*func)(void *), void *param,
+                                     uint32_t timeout_ms) {
+  (void)timeout_ms;
+  func(param);
+  return 0;
+}
+
+static inline bool flash_safe_execute_core_init(void) { return true; }
+
+#endif // SIMSDK_PICO_FLASH_H
@@ -0,0 +1,12 @@
+#ifndef SIMSDK_PICO_MULTICORE_H
+#define SIMSDK_PICO_MULTICORE_H
+
+#include "pico/stdlib.h"
+
+// psxsim runs both cores' work itself, in virtual time
+static inline void multicore_reset_core1(void) {}
+static inline void multicore_launch_core1(void (*entry)(void)) { (void)entry; }
+static inline void multicore_fifo_push_blocking(uint32_t data) { (void)data; }
+static inline uint32_t multicore_fifo_pop_blocking(void) { return 0; }
+
+#endif // SIMSDK_PICO_MULTICORE_H
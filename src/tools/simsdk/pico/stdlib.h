@@ -0,0 +1,48 @@
+#ifndef SIMSDK_PICO_STDLIB_H
+#define SIMSDK_PICO_STDLIB_H
+
+// Host stand-in for the parts of the Pico SDK the firmware uses, see
+// tools/psxsim.c. Time is the simulator's virtual time.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+absolute_time_t get_absolute_time(void);
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+#define GPIO_IN 0
+#define GPIO_OUT 1
+#define GPIO_SLEW_RATE_SLOW 0
+
+static inline void gpio_init(uint gpio) { (void)gpio; }
+static inline void gpio_set_dir(uint gpio, bool out) {
+  (void)gpio;
+  (void)out;
+}
+static inline void gpio_set_slew_rate(uint gpio, int slew) {
+  (void)gpio;
+  (void)slew;
+}
+static inline void gpio_clr_mask(uint32_t mask) { (void)mask; }
+bool gpio_get(uint gpio);
+
+static inline bool stdio_init_all(void) { return true; }
+static inline bool set_sys_clock_khz(uint32_t khz, bool required) {
+  (void)khz;
+  (void)required;
+  return true;
+}
+
+void hard_assert(bool condition);
+
+#endif // SIMSDK_PICO_STDLIB_H
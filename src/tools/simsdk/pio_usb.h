@@ -0,0 +1,10 @@
+#ifndef SIMSDK_PIO_USB_H
+#define SIMSDK_PIO_USB_H
+
+typedef struct {
+  int unused;
+} pio_usb_configuration_t;
+
+#define PIO_USB_DEFAULT_CONFIG {0}
+
+#endif // SIMSDK_PIO_USB_H
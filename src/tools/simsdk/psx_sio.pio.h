@@ -0,0 +1,35 @@
+#ifndef SIMSDK_PSX_SIO_PIO_H
+#define SIMSDK_PSX_SIO_PIO_H
+
+#include "hardware/pio.h"
+
+// Stand-in for the header pioasm generates from psx_sio.pio in the device
+// build. psxsim models the bus itself, so the program is empty; the pins must
+// match the .define public lines there, see test/piodefines.sh. siopio runs
+// the program itself, start included, see test/psx_sio.txt.
+
+#define psx_sio_ATT_PIN 7
+#define psx_sio_CLK_PIN 10
+
+#define psx_sio_offset_start 0u
+
+static const struct pio_program psx_sio_program = {
+    .instructions = NULL,
+    .length = 0,
+    .origin = -1,
+    .pio_version = 0,
+};
+
+static inline void psx_sio_program_init(PIO pio, uint sm, uint offset,
+                                        uint pin_cmd, uint pin_dat,
+                                        uint pin_ack, float freq) {
+  (void)pio;
+  (void)sm;
+  (void)offset;
+  (void)pin_cmd;
+  (void)pin_dat;
+  (void)pin_ack;
+  (void)freq;
+}
+
+#endif // SIMSDK_PSX_SIO_PIO_H
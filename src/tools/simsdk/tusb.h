@@ -0,0 +1,74 @@
+#ifndef SIMSDK_TUSB_H
+#define SIMSDK_TUSB_H
+
+#include "pico/stdlib.h"
+#include "tusb_config.h"
+
+// TinyUSB host calls of the firmware; psxsim.c replays the devices
+
+#define HID_PROTOCOL_BOOT 0
+#define HID_PROTOCOL_REPORT 1
+#define HID_ITF_PROTOCOL_NONE 0
+#define HID_ITF_PROTOCOL_KEYBOARD 1
+#define HID_ITF_PROTOCOL_MOUSE 2
+#define TUH_CFGID_RPI_PIO_USB_CONFIGURATION 100
+#define HID_DESC_TYPE_REPORT 0x22
+
+typedef enum { XFER_RESULT_SUCCESS, XFER_RESULT_FAILED } xfer_result_t;
+
+typedef struct tuh_xfer_s tuh_xfer_t;
+typedef void (*tuh_xfer_cb_t)(tuh_xfer_t *xfer);
+struct tuh_xfer_s {
+  uint8_t daddr;
+  xfer_result_t result;
+  uint32_t actual_len;
+  uint8_t *buffer;
+  uintptr_t user_data;
+};
+
+typedef struct {
+  uint8_t daddr;
+  struct {
+    uint8_t bInterfaceNumber;
+  } desc;
+} tuh_itf_info_t;
+
+bool tuh_hid_mounted(uint8_t dev_addr, uint8_t idx);
+bool tuh_hid_itf_get_info(uint8_t daddr, uint8_t idx, tuh_itf_info_t *info);
+bool tuh_descriptor_get_hid_report(uint8_t daddr, uint8_t itf_num,
+                                   uint8_t desc_type, uint8_t index,
+                                   void *buffer, uint16_t len,
+                                   tuh_xfer_cb_t complete_cb,
+                                   uintptr_t user_data);
+
+static inline void tuh_hid_set_default_protocol(uint8_t protocol) {
+  (void)protocol;
+}
+static inline bool tuh_configure(uint8_t rhport, uint32_t cfg_id,
+                                 const void *cfg_param) {
+  (void)rhport;
+  (void)cfg_id;
+  (void)cfg_param;
+  return true;
+}
+static inline bool tuh_init(uint8_t rhport) {
+  (void)rhport;
+  return true;
+}
+static inline void tuh_task(void) {}
+static inline bool tuh_task_event_ready(void) { return false; }
+
+uint8_t tuh_hid_interface_protocol(uint8_t dev_addr, uint8_t idx);
+bool tuh_vid_pid_get(uint8_t dev_addr, uint16_t *vid, uint16_t *pid);
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t idx);
+bool tuh_hid_set_protocol(uint8_t dev_addr, uint8_t idx, uint8_t protocol);
+
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t idx,
+                      uint8_t const *report_desc, uint16_t desc_len);
+void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t idx);
+void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t idx,
+                                      uint8_t protocol);
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t idx,
+                                uint8_t const *report, uint16_t len);
+
+#endif // SIMSDK_TUSB_H
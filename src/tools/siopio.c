@@ -0,0 +1,821 @@
+// Host run of psx_sio.pio itself: the program is assembled here from its
+// text, executed instruction by instruction on a model of one PIO state
+// machine, and given the TX words the firmware builds with siotiming.h. On the
+// other side of the pins a console clocks transactions and reads back what the
+// program drove, so the word layout of the C encoder is held against the
+// program rather than against psxsim's bus model.
+//
+// Build: the siopio target of CMakeLists.txt here; the psx_sio_program test
+// holds its output against test/psx_sio.txt
+// Usage: siopio psx_sio.pio
+//
+// The assembler takes the instructions and directives psx_sio.pio uses and
+// fails on anything else. The machine runs at SIO_FREQ like SIO_init() sets it
+// up: IN base CMD, OUT and SET base DAT, side-set ACK, shifting right, no
+// autopush or autopull. DAT and ACK are open drain, a pin direction of 1 pulls
+// the line low.
+//
+// A line per transaction, then a line per byte: the command byte, what the CPU
+// read from the RX FIFO, the byte the console read on DAT, and the ACK from
+// the last rising CLK edge and its width in ns, "-" for none. Each is checked
+// against what the transaction asked for, and the words against the decoders
+// psxsim reads them with; a mismatch is printed as such and fails the run.
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/pio.h"
+#include "psx_sio.pio.h"
+#include "siotiming.h"
+
+// must match usb-ps1-adapter.c
+#define SIO_FREQ 8000000
+#define GP_CMD 8
+#define GP_DAT 9
+#define GP_ACK 11
+
+#define CYCLE_NS (1000000000 / SIO_FREQ)
+#define ACK_TIMEOUT_NS 100000 // the console gives up on ACK
+#define INSTR_MAX 32
+#define SYMBOLS_MAX 32
+
+//--------------------------------------------------------------------+
+// Assembler
+//--------------------------------------------------------------------+
+
+typedef struct {
+  char name[32];
+  int value;
+  bool label;
+  bool public;
+} Symbol;
+
+typedef struct {
+  char text[INSTR_MAX][96];
+  int line[INSTR_MAX];
+  uint16_t code[INSTR_MAX];
+  uint8_t length;
+  uint8_t wrapTarget;
+  uint8_t wrap;
+  uint8_t sideBits; // side-set value bits, without the enable bit
+  bool sideOpt;
+  bool sidePindirs;
+  Symbol symbols[SYMBOLS_MAX];
+  uint8_t symbolCount;
+} Program;
+
+static Program gProg;
+static const char *gPath;
+static int gLine;
+
+static void fail(const char *what, const char *token) {
+  fprintf(stderr, "%s:%d: %s%s%s\n", gPath, gLine, what, token ? " " : "",
+          token ? token : "");
+  exit(1);
+}
+
+static const Symbol *symbolFind(const char *name) {
+  for (uint8_t i = 0; i != gProg.symbolCount; ++i) {
+    if (!strcmp(gProg.symbols[i].name, name)) {
+      return gProg.symbols + i;
+    }
+  }
+  return NULL;
+}
+
+static void symbolAdd(const char *name, int value, bool label, bool public) {
+  if (symbolFind(name) || gProg.symbolCount == SYMBOLS_MAX ||
+      strlen(name) >= sizeof(gProg.symbols[0].name)) {
+    fail("bad symbol", name);
+  }
+  Symbol *s = gProg.symbols + gProg.symbolCount++;
+  strcpy(s->name, name);
+  s->value = value;
+  s->label = label;
+  s->public = public;
+}
+
+static int value(const char *token) {
+  char *end;
+  long v;
+  if (!strncmp(token, "0b", 2)) {
+    v = strtol(token + 2, &end, 2);
+  } else {
+    v = strtol(token, &end, 0);
+  }
+  if (end != token && *end == 0) {
+    return (int)v;
+  }
+  const Symbol *s = symbolFind(token);
+  if (!s) {
+    fail("unknown symbol", token);
+  }
+  return s->value;
+}
+
+static int lookup(const char *token, const char *const *names, int count) {
+  for (int i = 0; i != count; ++i) {
+    if (names[i] && !strcmp(token, names[i])) {
+      return i;
+    }
+  }
+  fail("unexpected", token);
+  return -1;
+}
+
+// splits at blanks and commas, in place; returns the number of tokens
+static int tokenize(char *s, char **tokens, int max) {
+  int n = 0;
+  for (char *t = strtok(s, " \t,"); t; t = strtok(NULL, " \t,")) {
+    if (n == max) {
+      fail("too many operands", NULL);
+    }
+    tokens[n++] = t;
+  }
+  return n;
+}
+
+// counts of 32 are encoded as 0
+static uint16_t bitCount(const char *token) {
+  const int n = value(token);
+  if (n < 1 || n > 32) {
+    fail("bad bit count", token);
+  }
+  return n & 31;
+}
+
+static const char *const JMP_CONDS[] = {"",   "!x",  "x--", "!y",
+                                        "y--", "x!=y", "pin", "!osre"};
+static const char *const IN_SRCS[] = {"pins", "x",  "y",   "null",
+                                      NULL,   NULL, "isr", "osr"};
+static const char *const OUT_DESTS[] = {"pins",    "x",  "y",   "null",
+                                        "pindirs", "pc", "isr", "exec"};
+static const char *const SET_DESTS[] = {"pins", "x", "y", NULL, "pindirs"};
+static const char *const WAIT_SRCS[] = {"gpio", "pin", "irq"};
+
+static uint16_t encode(char *text) {
+  char *tokens[8];
+  int n = tokenize(text, tokens, 8);
+  if (n == 0) {
+    fail("empty instruction", NULL);
+  }
+
+  // [delay] and side value come last, in either order
+  int delay = 0;
+  int side = -1;
+  while (n > 1) {
+    const char *t = tokens[n - 1];
+    if (t[0] == '[' && t[strlen(t) - 1] == ']') {
+      char d[16];
+      snprintf(d, sizeof(d), "%.*s", (int)strlen(t) - 2, t + 1);
+      delay = value(d);
+      --n;
+    } else if (n > 2 && !strcmp(tokens[n - 2], "side")) {
+      side = value(t);
+      n -= 2;
+    } else {
+      break;
+    }
+  }
+
+  const char *op = tokens[0];
+  uint16_t code;
+  if (!strcmp(op, "jmp")) {
+    const int cond = n == 3 ? lookup(tokens[1], JMP_CONDS, 8) : 0;
+    if (n != 2 && n != 3) {
+      fail("jmp takes a condition and a target", NULL);
+    }
+    code = 0x0000 | cond << 5 | value(tokens[n - 1]);
+  } else if (!strcmp(op, "wait")) {
+    if (n != 4) {
+      fail("wait takes polarity, source and index", NULL);
+    }
+    code = 0x2000 | (value(tokens[1]) & 1) << 7 |
+           lookup(tokens[2], WAIT_SRCS, 3) << 5 | value(tokens[3]);
+  } else if (!strcmp(op, "in") && n == 3) {
+    code = 0x4000 | lookup(tokens[1], IN_SRCS, 8) << 5 | bitCount(tokens[2]);
+  } else if (!strcmp(op, "out") && n == 3) {
+    code = 0x6000 | lookup(tokens[1], OUT_DESTS, 8) << 5 | bitCount(tokens[2]);
+  } else if (!strcmp(op, "push") || !strcmp(op, "pull")) {
+    const bool pull = op[1] == 'u' && op[2] == 'l';
+    bool block = true;
+    bool ifFlag = false;
+    for (int i = 1; i != n; ++i) {
+      if (!strcmp(tokens[i], "block")) {
+        block = true;
+      } else if (!strcmp(tokens[i], "noblock")) {
+        block = false;
+      } else if (!strcmp(tokens[i], pull ? "ifempty" : "iffull")) {
+        ifFlag = true;
+      } else {
+        fail("unexpected", tokens[i]);
+      }
+    }
+    code = 0x8000 | pull << 7 | ifFlag << 6 | block << 5;
+  } else if (!strcmp(op, "set") && n == 3) {
+    const int data = value(tokens[2]);
+    if (data < 0 || data > 31) {
+      fail("bad set value", tokens[2]);
+    }
+    code = 0xE000 | lookup(tokens[1], SET_DESTS, 5) << 5 | data;
+  } else if (!strcmp(op, "nop") && n == 1) {
+    code = 0xA042; // mov y, y
+  } else {
+    fail("unsupported instruction", op);
+    return 0;
+  }
+
+  const int sideField = gProg.sideBits + gProg.sideOpt;
+  if (delay < 0 || delay >= 1 << (5 - sideField)) {
+    fail("delay out of range", NULL);
+  }
+  code |= delay << 8;
+  if (side >= 0) {
+    if (!gProg.sideBits || side >= 1 << gProg.sideBits) {
+      fail("bad side-set", NULL);
+    }
+    code |= gProg.sideOpt ? 0x1000 | side << (12 - gProg.sideBits)
+                          : side << (13 - gProg.sideBits);
+  } else if (gProg.sideBits && !gProg.sideOpt) {
+    fail("side-set is not optional", NULL);
+  }
+  return code;
+}
+
+// the first program of the file; % blocks are left to pioasm's users
+static void assemble(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fail("cannot open", path);
+  }
+  char buf[256];
+  bool inBlock = false;
+  bool haveWrap = false;
+  int programs = 0;
+  gProg.wrap = INSTR_MAX;
+  while (fgets(buf, sizeof(buf), f)) {
+    ++gLine;
+    if (inBlock) {
+      inBlock = strncmp(buf, "%}", 2) != 0;
+      continue;
+    }
+    if (buf[0] == '%') {
+      inBlock = true;
+      continue;
+    }
+    buf[strcspn(buf, ";\r\n")] = 0;
+    char *comment = strstr(buf, "//");
+    if (comment) {
+      *comment = 0;
+    }
+    char *s = buf;
+    while (isspace((unsigned char)*s)) {
+      ++s;
+    }
+    if (*s == 0 || programs > 1) {
+      continue;
+    }
+
+    bool public = false;
+    if (!strncmp(s, "public ", 7)) {
+      public = true;
+      s += 7;
+    }
+    char *colon = strchr(s, ':');
+    if (colon) {
+      *colon = 0;
+      symbolAdd(s, gProg.length, true, public);
+      s = colon + 1;
+      while (isspace((unsigned char)*s)) {
+        ++s;
+      }
+      if (*s == 0) {
+        continue;
+      }
+    }
+
+    if (*s == '.') {
+      char *tokens[6];
+      const int n = tokenize(s, tokens, 6);
+      if (!strcmp(tokens[0], ".program")) {
+        ++programs;
+      } else if (!strcmp(tokens[0], ".side_set") && n >= 2) {
+        gProg.sideBits = value(tokens[1]);
+        for (int i = 2; i != n; ++i) {
+          if (!strcmp(tokens[i], "opt")) {
+            gProg.sideOpt = true;
+          } else if (!strcmp(tokens[i], "pindirs")) {
+            gProg.sidePindirs = true;
+          } else {
+            fail("unexpected", tokens[i]);
+          }
+        }
+      } else if (!strcmp(tokens[0], ".define")) {
+        const bool pub = n == 4 && !strcmp(tokens[1], "public");
+        if (n != 3 + pub) {
+          fail("bad .define", NULL);
+        }
+        symbolAdd(tokens[1 + pub], value(tokens[2 + pub]), false, pub);
+      } else if (!strcmp(tokens[0], ".wrap_target")) {
+        gProg.wrapTarget = gProg.length;
+      } else if (!strcmp(tokens[0], ".wrap")) {
+        gProg.wrap = gProg.length - 1;
+        haveWrap = true;
+      } else if (strcmp(tokens[0], ".pio_version")) {
+        fail("unsupported directive", tokens[0]);
+      }
+      continue;
+    }
+
+    if (gProg.length == INSTR_MAX) {
+      fail("program too long", NULL);
+    }
+    size_t len = strlen(s);
+    while (len && isspace((unsigned char)s[len - 1])) {
+      s[--len] = 0;
+    }
+    if (len >= sizeof(gProg.text[0])) {
+      fail("line too long", NULL);
+    }
+    memcpy(gProg.text[gProg.length], s, len + 1);
+    gProg.line[gProg.length++] = gLine;
+  }
+  fclose(f);
+  if (!haveWrap) {
+    gProg.wrap = gProg.length - 1;
+  }
+
+  // labels are all known now
+  for (uint8_t i = 0; i != gProg.length; ++i) {
+    char text[96];
+    memcpy(text, gProg.text[i], sizeof(text));
+    gLine = gProg.line[i];
+    gProg.code[i] = encode(text);
+  }
+}
+
+//--------------------------------------------------------------------+
+// State machine
+//--------------------------------------------------------------------+
+
+typedef struct {
+  uint8_t pc;
+  uint32_t x;
+  uint32_t y;
+  uint32_t osr;
+  uint32_t isr;
+  uint8_t osrCount; // bits shifted out since the last pull
+  uint8_t isrCount; // bits shifted in since the last push
+  uint32_t tx[4];
+  uint8_t txCount;
+  uint32_t rx[4];
+  uint8_t rxCount;
+  uint8_t delay; // cycles left of the last instruction
+  bool datDir;   // 1 = DAT pulled low
+  bool ackDir;   // 1 = ACK pulled low
+} Sm;
+
+// the console's side of the bus
+typedef struct {
+  bool att;
+  bool clk;
+  bool cmd;
+} Bus;
+
+static Sm gSm;
+static Bus gBus = {true, true, true};
+static uint64_t gNs;
+
+static bool gpioRead(uint8_t gpio) {
+  if (gpio == psx_sio_ATT_PIN) {
+    return gBus.att;
+  }
+  if (gpio == psx_sio_CLK_PIN) {
+    return gBus.clk;
+  }
+  if (gpio == GP_CMD) {
+    return gBus.cmd;
+  }
+  if (gpio == GP_DAT) {
+    return !gSm.datDir;
+  }
+  if (gpio == GP_ACK) {
+    return !gSm.ackDir;
+  }
+  fprintf(stderr, "psx_sio reads GPIO %u, not on the bus\n", gpio);
+  exit(1);
+}
+
+// DAT is OUT and SET base, ACK side-set base; one pin each
+static void pinsWrite(bool dirs, uint32_t v) {
+  if (!dirs) {
+    fprintf(stderr, "psx_sio drives a pin value, DAT and ACK are open drain\n");
+    exit(1);
+  }
+  gSm.datDir = v & 1;
+}
+
+// Executes code, false if it stalls. exec is an instruction written by the
+// CPU, whose delay does not count.
+static bool smExecute(uint16_t code, bool exec) {
+  const int sideField = gProg.sideBits + gProg.sideOpt;
+  if (gProg.sideOpt ? code & 0x1000 : gProg.sideBits != 0) {
+    const uint32_t side =
+        code >> (13 - sideField) & ((1u << gProg.sideBits) - 1);
+    if (!gProg.sidePindirs) {
+      fprintf(stderr, "psx_sio side-sets a pin value, ACK is open drain\n");
+      exit(1);
+    }
+    gSm.ackDir = side & 1; // applied even if the instruction stalls
+  }
+  const uint8_t delay = exec ? 0 : code >> 8 & ((1u << (5 - sideField)) - 1);
+  const uint8_t arg = code >> 5 & 7;
+  const uint8_t low = code & 31;
+  const uint8_t bits = low ? low : 32;
+  uint8_t next = gSm.pc == gProg.wrap ? gProg.wrapTarget : gSm.pc + 1;
+
+  switch (code >> 13) {
+  case 0: { // jmp
+    bool take = true;
+    switch (arg) {
+    case 1:
+      take = gSm.x == 0;
+      break;
+    case 2:
+      take = gSm.x-- != 0;
+      break;
+    case 3:
+      take = gSm.y == 0;
+      break;
+    case 4:
+      take = gSm.y-- != 0;
+      break;
+    case 5:
+      take = gSm.x != gSm.y;
+      break;
+    case 0:
+      break;
+    default:
+      fprintf(stderr, "jmp condition %u not modelled\n", arg);
+      exit(1);
+    }
+    if (take) {
+      next = low;
+    }
+    break;
+  }
+  case 1: // wait
+    if ((arg & 3) != 0) {
+      fprintf(stderr, "wait source %u not modelled\n", arg & 3);
+      exit(1);
+    }
+    if (gpioRead(low) != (bool)(code & 0x80)) {
+      return false;
+    }
+    break;
+  case 2: { // in, shifting right
+    uint32_t v;
+    switch (arg) {
+    case 0:
+      v = gpioRead(GP_CMD); // one pin from the IN base
+      break;
+    case 1:
+      v = gSm.x;
+      break;
+    case 2:
+      v = gSm.y;
+      break;
+    case 3:
+      v = 0;
+      break;
+    default:
+      fprintf(stderr, "in source %u not modelled\n", arg);
+      exit(1);
+    }
+    v &= bits == 32 ? ~0u : (1u << bits) - 1;
+    gSm.isr = bits == 32 ? v : gSm.isr >> bits | v << (32 - bits);
+    gSm.isrCount = gSm.isrCount + bits > 32 ? 32 : gSm.isrCount + bits;
+    break;
+  }
+  case 3: { // out, shifting right
+    const uint32_t v = bits == 32 ? gSm.osr : gSm.osr & ((1u << bits) - 1);
+    gSm.osr = bits == 32 ? 0 : gSm.osr >> bits;
+    gSm.osrCount = gSm.osrCount + bits > 32 ? 32 : gSm.osrCount + bits;
+    switch (arg) {
+    case 0:
+    case 4:
+      pinsWrite(arg == 4, v);
+      break;
+    case 1:
+      gSm.x = v;
+      break;
+    case 2:
+      gSm.y = v;
+      break;
+    case 3:
+      break;
+    default:
+      fprintf(stderr, "out destination %u not modelled\n", arg);
+      exit(1);
+    }
+    break;
+  }
+  case 4: { // push or pull, thresholds 8 and 32
+    const bool block = code & 0x20;
+    if (code & 0x80) {
+      if ((code & 0x40) && gSm.osrCount < 32) {
+        break;
+      }
+      if (gSm.txCount == 0) {
+        if (block) {
+          return false;
+        }
+        gSm.osr = gSm.x;
+      } else {
+        gSm.osr = gSm.tx[0];
+        memmove(gSm.tx, gSm.tx + 1, --gSm.txCount * sizeof(gSm.tx[0]));
+      }
+      gSm.osrCount = 0;
+    } else {
+      if ((code & 0x40) && gSm.isrCount < 8) {
+        break;
+      }
+      if (gSm.rxCount == 4) {
+        if (block) {
+          return false;
+        }
+      } else {
+        gSm.rx[gSm.rxCount++] = gSm.isr;
+      }
+      gSm.isr = 0;
+      gSm.isrCount = 0;
+    }
+    break;
+  }
+  case 5: // mov, only the nop
+    if (code != 0xA042 && (code & 0xE0FF) != 0xA042) {
+      fprintf(stderr, "mov %04x not modelled\n", code);
+      exit(1);
+    }
+    break;
+  case 7: // set
+    switch (arg) {
+    case 1:
+      gSm.x = low;
+      break;
+    case 2:
+      gSm.y = low;
+      break;
+    case 4:
+      pinsWrite(true, low);
+      break;
+    default:
+      fprintf(stderr, "set destination %u not modelled\n", arg);
+      exit(1);
+    }
+    break;
+  default:
+    fprintf(stderr, "instruction %04x not modelled\n", code);
+    exit(1);
+  }
+  gSm.pc = next;
+  gSm.delay = delay;
+  return true;
+}
+
+static void smCycle() {
+  if (gSm.delay) {
+    --gSm.delay;
+    return;
+  }
+  smExecute(gProg.code[gSm.pc], false);
+}
+
+//--------------------------------------------------------------------+
+// CPU and console
+//--------------------------------------------------------------------+
+
+// the CPU's side: the words it puts, each reactNs after the byte it is for
+typedef struct {
+  uint32_t words[16];
+  uint8_t count;
+  uint8_t next;
+  uint32_t reactNs;
+  uint64_t putNs; // when words[next] goes in, 0 = waiting for a byte
+  uint8_t read[16];
+  uint8_t readCount;
+} Cpu;
+
+static Cpu gCpu;
+static uint64_t gPushNs; // the CPU saw the last byte
+
+// runs up to ns, or to the next ACK edge if untilAck; true on an edge
+static bool runUntil(uint64_t ns, bool untilAck) {
+  while (gNs < ns) {
+    if (gSm.rxCount) {
+      gCpu.read[gCpu.readCount++] = gSm.rx[0] >> 24;
+      memmove(gSm.rx, gSm.rx + 1, --gSm.rxCount * sizeof(gSm.rx[0]));
+      gPushNs = gNs;
+      gCpu.putNs = gNs + gCpu.reactNs;
+    }
+    if (gCpu.putNs && gNs >= gCpu.putNs && gCpu.next != gCpu.count) {
+      gSm.tx[gSm.txCount++] = gCpu.words[gCpu.next++];
+      gCpu.putNs = 0;
+    }
+    const bool ack = gSm.ackDir;
+    smCycle();
+    gNs += CYCLE_NS;
+    if (untilAck && ack != gSm.ackDir) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// what SIO_reset() does: a restart at the start of the program, both lines
+// released and the response for byte 0 queued
+static void sioReset(uint8_t delay) {
+  gSm.txCount = 0;
+  gSm.rxCount = 0;
+  gSm.isr = 0;
+  gSm.isrCount = 0;
+  gSm.osrCount = 32;
+  gSm.delay = 0;
+  smExecute(pio_encode_set(pio_pindirs, 0) | pio_encode_sideset_opt(1, 0),
+            true);
+  smExecute(pio_encode_jmp(psx_sio_offset_start), true);
+  gSm.tx[gSm.txCount++] = sioFirstWord(0xFF, delay);
+}
+
+typedef struct {
+  const char *name;
+  uint32_t periodNs; // CLK
+  uint32_t gapNs;    // ACK release to the next byte
+  uint32_t reactNs;  // byte to verdict on the CPU
+  uint8_t delay;
+  uint8_t width;
+  uint8_t count;
+  uint8_t cmd[8];
+  uint8_t response[8]; // byte 0 is always idle
+  bool ack[8];
+} Transaction;
+
+static const Transaction TRANSACTIONS[] = {
+    {"poll, safe timing",
+     4000,
+     10000,
+     3000,
+     SIO_DELAY_SAFE,
+     SIO_WIDTH_SAFE,
+     5,
+     {0x01, 0x42, 0x00, 0x00, 0x00},
+     {0xFF, 0x12, 0x5A, 0xFF, 0xFF},
+     {true, true, true, true, false}},
+    {"poll, adapted timing at 500 kHz",
+     2000,
+     2000,
+     3000,
+     6,
+     2,
+     5,
+     {0x01, 0x42, 0x00, 0x00, 0x00},
+     {0xFF, 0x12, 0x5A, 0xF7, 0xFF},
+     {true, true, true, true, false}},
+    {"memory card, not answered",
+     4000,
+     10000,
+     3000,
+     SIO_DELAY_SAFE,
+     SIO_WIDTH_SAFE,
+     2,
+     {0x81, 0x52},
+     {0xFF, 0xFF},
+     {false, false}},
+    {"verdict after the ACK delay",
+     4000,
+     10000,
+     20000,
+     SIO_DELAY_SAFE,
+     SIO_WIDTH_SAFE,
+     3,
+     {0x01, 0x42, 0x00},
+     {0xFF, 0x41, 0x5A},
+     {true, true, false}},
+};
+
+static bool transaction(const Transaction *t) {
+  const uint32_t timing = sioVerdictTiming(t->width, t->delay);
+  memset(&gCpu, 0, sizeof(gCpu));
+  gCpu.reactNs = t->reactNs;
+  for (uint8_t i = 0; i != t->count; ++i) {
+    const uint8_t next = i + 1 < t->count ? t->response[i + 1] : 0xFF;
+    gCpu.words[gCpu.count++] = sioVerdict(t->ack[i], next, timing);
+  }
+  sioReset(t->delay);
+  runUntil(gNs + 10000, false);
+
+  printf("%s: %u ns CLK, delay %u width %u\n", t->name, t->periodNs, t->delay,
+         t->width);
+  bool ok = true;
+  gBus.att = false;
+  uint64_t at = gNs + 20000;
+  for (uint8_t i = 0; i != t->count; ++i) {
+    uint8_t dat = 0;
+    for (uint8_t b = 0; b != 8; ++b) {
+      runUntil(at + b * t->periodNs, false);
+      gBus.clk = false;
+      gBus.cmd = t->cmd[i] >> b & 1;
+      runUntil(at + b * t->periodNs + t->periodNs / 2, false);
+      gBus.clk = true;
+      dat |= gpioRead(GP_DAT) << b;
+    }
+    const uint64_t rise = gNs;
+    const bool acked = runUntil(rise + ACK_TIMEOUT_NS, true);
+    const uint64_t fall = gNs;
+    if (acked) {
+      runUntil(fall + ACK_TIMEOUT_NS, true);
+    }
+    const uint64_t width = gNs - fall;
+
+    const uint8_t read = gCpu.readCount > i ? gCpu.read[i] : 0;
+    printf("  cmd %02x read %02x dat %02x", t->cmd[i], read, dat);
+    if (acked) {
+      printf(" ack %llu +%llu\n", (unsigned long long)(fall - rise),
+             (unsigned long long)width);
+    } else {
+      printf(" ack -\n");
+    }
+
+    if (read != t->cmd[i] || dat != t->response[i]) {
+      printf("  mismatch: byte\n");
+      ok = false;
+    }
+    // ACK after the delay, or a few cycles after a later verdict; as wide as
+    // asked for, give or take a cycle or two of the loops around it
+    const uint64_t due = rise + (t->delay + 1) * 1000u;
+    const uint64_t put = gPushNs + t->reactNs;
+    const uint64_t from = due > put ? due : put;
+    const uint64_t asked = (t->width + 1) * 1000u;
+    if (acked != t->ack[i] ||
+        (acked && (fall < from || fall > from + 16 * CYCLE_NS ||
+                   width < asked || width > asked + 2 * CYCLE_NS))) {
+      printf("  mismatch: ack\n");
+      ok = false;
+    }
+
+    // and psxsim, which reads the same words back
+    const uint32_t word = gCpu.words[i];
+    const uint32_t first = sioFirstWord(0xFF, t->delay);
+    const uint8_t next = i + 1 < t->count ? t->response[i + 1] : 0xFF;
+    if ((i == 0 && (sioFirstResponse(first) != 0xFF ||
+                    sioFirstDelay(first) != t->delay)) ||
+        sioVerdictAck(word) != t->ack[i] || sioVerdictNext(word) != next ||
+        sioVerdictWidth(word) != t->width ||
+        sioVerdictDelay(word) != t->delay) {
+      printf("  mismatch: decoder\n");
+      ok = false;
+    }
+    if (!acked) {
+      break;
+    }
+    at = gNs + t->gapNs;
+  }
+  runUntil(gNs + 10000, false);
+  gBus.att = true;
+  runUntil(gNs + 10000, false);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: siopio psx_sio.pio\n");
+    return 2;
+  }
+  gPath = argv[1];
+  assemble(gPath);
+
+  // the public symbols are the ones the firmware builds against
+  bool ok = true;
+  const Symbol *start = symbolFind("start");
+  if (!start || !start->public || start->value != psx_sio_offset_start) {
+    printf("mismatch: start is not psx_sio_offset_start\n");
+    ok = false;
+  }
+  printf("psx_sio: %u instructions, wrap %u..%u\n", gProg.length,
+         gProg.wrapTarget, gProg.wrap);
+  for (uint8_t i = 0; i != gProg.length; ++i) {
+    printf("  %2u %04x %s\n", i, gProg.code[i], gProg.text[i]);
+  }
+
+  // psx_sio_program_init() enables it at the start of the program
+  gSm.pc = 0;
+  for (uint32_t i = 0; i != sizeof(TRANSACTIONS) / sizeof(TRANSACTIONS[0]);
+       ++i) {
+    ok &= transaction(TRANSACTIONS + i);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Runs a command and compares its standard output with an expected file.
+#
+# Usage: golden.sh expected command [arguments]
+# UPDATE=1 writes the expected file instead.
+
+set -e
+expected=$1
+shift
+out=$(mktemp)
+trap 'rm -f "$out"' EXIT
+
+"$@" >"$out"
+
+if [ -n "$UPDATE" ]; then
+  cp "$out" "$expected"
+  exit 0
+fi
+diff -u "$expected" "$out"
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Checks that a stand-in for a pioasm header defines the .define public
+# values of its program as pioasm would, prog_NAME.
+#
+# Usage: piodefines.sh program.pio standin.pio.h
+
+set -e
+pio=$1
+header=$2
+prog=$(sed -n 's/^\.program[[:space:]]*\([A-Za-z0-9_]*\).*/\1/p' "$pio")
+status=0
+public='s/^\.define[[:space:]]*public[[:space:]]*\([A-Za-z0-9_]*\)'
+public=$public'[[:space:]]*\([0-9]*\).*/\1=\2/p'
+for define in $(sed -n "$public" "$pio"); do
+  name=${define%%=*}
+  value=${define#*=}
+  if ! grep -q "^#define ${prog}_${name} ${value}\$" "$header"; then
+    echo "$header: ${prog}_${name} is not $value as in $pio"
+    status=1
+  fi
+done
+exit $status
@@ -0,0 +1,126 @@
+#!/bin/sh
+# Replays USB devices through psxsim and compares what the console got with
+# an expected file. psxsim runs on virtual time alone (-s 0), so the outcome
+# does not depend on the host.
+#
+# Usage: simtest.sh psxsim view expected [psxsim options]
+#   polls   a line per poll: time in us, then the reply bytes
+#   motion  a line per poll: dx dy of each mouse reply in it, by multitap
+#           slot ("-" without multitap), "sat" where an axis is at the 8-bit
+#           limit, "." for none; then the totals per slot, and whether
+#           they add up to what core0 committed as sent
+#   stats   the report counters of the firmware, then the reports the
+#           devices had, those that waited to be asked for and those lost,
+#           and whether the firmware received all of them
+#   profile the profile store at the end: active profile, records still to
+#           write, flash sectors erased and pages programmed
+# Every view ends with the bus summary. UPDATE=1 writes the expected file.
+
+set -e
+sim=$1
+view=$2
+expected=$3
+shift 3
+out=$(mktemp)
+trap 'rm -f "$out"' EXIT
+
+"$sim" -s 0 -v "$@" 2>/dev/null | awk -v view="$view" '
+function field(name, k, p, v) {
+  k = "\"" name "\":\""
+  p = index($0, k)
+  if (!p) {
+    return ""
+  }
+  v = substr($0, p + length(k))
+  return substr(v, 1, index(v, "\"") - 1)
+}
+function byte(h) {
+  h = index("0123456789abcdef", substr(h, 1, 1)) * 16 - 17 + \
+      index("0123456789abcdef", substr(h, 2, 1))
+  return h >= 128 ? h - 256 : h
+}
+function mouse(label, b, i, dx, dy, s) {
+  dx = byte(b[i + 4])
+  dy = byte(b[i + 5])
+  if (!(label in totalX)) {
+    labels[++labelCount] = label
+  }
+  totalX[label] += dx
+  totalY[label] += dy
+  s = label " " dx " " dy
+  if (dx == 127 || dx == -128 || dy == 127 || dy == -128) {
+    s = s " sat"
+  }
+  return s
+}
+/"event":"poll"/ {
+  n = split(field("data"), b, " ")
+  if (view == "polls") {
+    print field("timestamp"), field("data")
+  } else if (view == "motion") {
+    line = ""
+    if (b[1] == "12" && n >= 6) {
+      line = mouse("-", b, 1)
+    } else if (b[1] == "80") {
+      for (s = 0; s != 4; ++s) {
+        i = 3 + s * 8
+        if (b[i] == "12" && n >= i + 5) {
+          line = line (line == "" ? "" : "  ") mouse("s" s, b, i)
+        }
+      }
+    }
+    print line == "" ? "." : line
+  }
+}
+/"event":"latency"/ && view == "stats" {
+  received = field("reports_received")
+  print "reports received", field("reports_received"), "coalesced",
+        field("reports_coalesced"), "dropped", field("reports_dropped")
+}
+/"event":"sim"/ && view == "stats" {
+  print "usb reports", field("usb_reports"), "waited", field("usb_waited"),
+        "lost", field("usb_lost")
+  missed = field("usb_reports") - received
+  print missed ? missed " reports not received" : "every report received"
+}
+/"event":"sim"/ && view == "profile" {
+  print "profile active", field("profile_active"), "pending",
+        field("profile_pending"), "erases", field("flash_erases"),
+        "programs", field("flash_programs")
+}
+/"event":"sim"/ {
+  split(field("sent_x"), sentX, " ")
+  split(field("sent_y"), sentY, " ")
+  summary = "polls " field("polls") " bytes " field("bytes") " lost " \
+            field("lost") " late_acks " field("late_acks")
+}
+END {
+  for (i = 1; i <= labelCount; ++i) {
+    print "total", labels[i], totalX[labels[i]], totalY[labels[i]]
+  }
+  if (view == "motion") {
+    # motion reaches the console exactly once: without multitap the slots
+    # share the one reply
+    conserved = 1
+    for (s = 0; s != 4; ++s) {
+      label = ("-" in totalX) ? "-" : "s" s
+      wantX[label] += sentX[s + 1]
+      wantY[label] += sentY[s + 1]
+    }
+    for (label in wantX) {
+      if (wantX[label] != totalX[label] + 0 ||
+          wantY[label] != totalY[label] + 0) {
+        conserved = 0
+        print "committed", label, wantX[label], wantY[label]
+      }
+    }
+    print conserved ? "motion conserved" : "motion not conserved"
+  }
+  print summary
+}' >"$out"
+
+if [ -n "$UPDATE" ]; then
+  cp "$out" "$expected"
+  exit 0
+fi
+diff -u "$expected" "$out"
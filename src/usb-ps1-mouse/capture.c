@@ -0,0 +1,109 @@
+#include "capture.h"
+
+#include <stdio.h>
+
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "sram.h"
+
+#define CAP_RUNNING 0
+#define CAP_FULL 1 // core1 owns the buffer until it sets CAP_RUNNING again
+
+#define LINE_RECORDS 32
+
+typedef struct {
+  uint16_t dt;
+  uint16_t pins;
+} CaptureRecord;
+
+static CaptureRecord gCapBuf[CAPTURE_RECORDS];
+static volatile uint8_t gCapState = CAP_RUNNING;
+
+// core0
+static uint32_t gCapCount = 0;
+static uint32_t gCapTicks = 0;  // sys clock ticks since the last record
+static uint32_t gCapPrevCvr = 0; // previous SysTick value (counts down)
+static uint16_t gCapPins = 0xffff;
+
+// core1
+static uint32_t gCapDumped = 0;
+static uint32_t gCapWindow = 0;
+
+void captureInit() {
+  // free running 24-bit SysTick on the processor clock as cycle counter
+  systick_hw->csr = 0;
+  systick_hw->rvr = 0x00ffffff;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 5; // CLKSOURCE | ENABLE
+  gCapPrevCvr = systick_hw->cvr;
+}
+
+static inline void SRAM_FUNC(capturePut)(uint16_t dt, uint16_t pins) {
+  gCapBuf[gCapCount].dt = dt;
+  gCapBuf[gCapCount].pins = pins;
+  ++gCapCount;
+}
+
+void SRAM_FUNC(captureSample)() {
+  if (gCapState != CAP_RUNNING) {
+    return;
+  }
+  const uint32_t cvr = systick_hw->cvr;
+  gCapTicks += (gCapPrevCvr - cvr) & 0x00ffffff;
+  gCapPrevCvr = cvr;
+
+  const uint16_t pins = (gpio_get_all() >> CAPTURE_PIN_BASE) & CAPTURE_PIN_MASK;
+  if (pins == gCapPins) {
+    return;
+  }
+  gCapPins = pins;
+
+  uint32_t dt = gCapCount ? gCapTicks / CAPTURE_TICK_DIV : 0;
+  gCapTicks = 0;
+  if (dt > 0xffff) {
+    capturePut(dt >> 16, CAPTURE_EXT);
+    dt &= 0xffff;
+  }
+  capturePut(dt, pins);
+  if (gCapCount + 2 > CAPTURE_RECORDS) {
+    __dmb();
+    gCapState = CAP_FULL;
+  }
+}
+
+void captureDumpTask() {
+  if (gCapState != CAP_FULL) {
+    return;
+  }
+  __dmb();
+  const uint32_t count = gCapCount;
+  if (gCapDumped == 0) {
+    printf("{\"event\":\"capture_start\",\"window\":\"%lu\",\"tick_hz\":"
+           "\"%lu\",\"records\":\"%lu\"},\n",
+           (unsigned long)gCapWindow,
+           (unsigned long)(clock_get_hz(clk_sys) / CAPTURE_TICK_DIV),
+           (unsigned long)count);
+  }
+  printf("{\"event\":\"capture\",\"window\":\"%lu\",\"offset\":\"%lu\","
+         "\"data\":\"",
+         (unsigned long)gCapWindow, (unsigned long)gCapDumped);
+  for (uint32_t i = 0; i != LINE_RECORDS && gCapDumped != count; ++i) {
+    const CaptureRecord *r = gCapBuf + gCapDumped;
+    printf("%04x%04x", r->dt, r->pins);
+    ++gCapDumped;
+  }
+  printf("\"},\n");
+  if (gCapDumped == count) {
+    printf("{\"event\":\"capture_end\",\"window\":\"%lu\"},\n",
+           (unsigned long)gCapWindow);
+    gCapDumped = 0;
+    ++gCapWindow;
+    // restart on core0: the next record carries the full pin state
+    gCapCount = 0;
+    gCapPins = 0xffff;
+    __dmb();
+    gCapState = CAP_RUNNING;
+  }
+}
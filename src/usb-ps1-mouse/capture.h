@@ -0,0 +1,28 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+// PS1 bus capture: core0 samples ATT..ACK between SM_task() calls and logs
+// every change of the pins into a RAM buffer; when the buffer is full, core1
+// prints it to stdio and capturing starts over. Decode the log with
+// tools/psxcap.c.
+//
+// Record format, 4 bytes little endian:
+//   uint16_t dt;   ticks since the previous record, CAPTURE_TICK_HZ
+//   uint16_t pins; GPIO 7..15 in bits 0..8 (ATT = 0, CLK = 3, DAT = 4,
+//                  CMD = 7, ACK = 8)
+// A record with CAPTURE_EXT set in pins only extends time: its dt counts
+// 65536 ticks each and is added to the next record.
+
+#define CAPTURE_PIN_BASE 7
+#define CAPTURE_PIN_MASK 0x1ff
+#define CAPTURE_EXT 0x8000
+#define CAPTURE_RECORDS 4096
+#define CAPTURE_TICK_DIV 4 // ticks are sys clock / 4
+
+void captureInit(); // core0
+void captureSample(); // core0, as often as possible
+void captureDumpTask(); // core1, prints one line per call when due
+
+#endif // CAPTURE_H
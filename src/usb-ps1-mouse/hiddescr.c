@@ -0,0 +1,239 @@
+#include "hiddescr.h"
+
+#include <string.h>
+
+// item prefix >> 2: tag and type, size stripped
+#define USAGE_PAGE 0x01
+#define USAGE 0x02
+#define COLLECTION 0x28
+#define END_COLLECTION 0x30
+#define USAGE_MINIMUM 0x06
+#define USAGE_MAXIMUM 0x0A
+#define LOGICAL_MINIMUM 0x05
+#define LOGICAL_MAXIMUM 0x09
+#define REPORT_COUNT 0x25
+#define REPORT_SIZE 0x1D
+#define INPUT 0x20
+#define OUTPUT 0x24
+#define FEATURE 0x2C
+#define REPORTID 0x21
+#define PUSH 0x29
+#define POP 0x2D
+
+#define LONG_ITEM 0xfe
+
+//---------------COLLECTION-----------------
+#define Application 0x01
+
+#define HID_STACK 4 // push depth
+#define HID_IDS 16  // report IDs tracked
+
+typedef struct {
+  HidInput in; // globals and locals for the next main item
+  HidGlobals stack[HID_STACK];
+  uint32_t depth; // pushes
+  uint32_t level; // collection nesting
+  uint32_t appLevel;
+  uint32_t rangeItems; // USAGE_MINIMUM 1, USAGE_MAXIMUM 2, since a main item
+  uint32_t idCount;
+  uint8_t ids[HID_IDS];
+  uint32_t bits[HID_IDS]; // input bits so far per report ID
+} HidWalker;
+
+// usage as sent, with the current page unless it is an extended one
+static uint32_t fullUsage(const HidWalker *w, uint32_t data, uint32_t len) {
+  return len == 4 ? data : (w->in.g.page << 16) | (data & 0xffff);
+}
+
+// The usage range of a main item, once its local items are all in: they come
+// in any order
+static void rangeDone(HidWalker *w) {
+  HidInput *in = &w->in;
+  in->haveRange = w->rangeItems == 3 && in->usageMax >= in->usageMin;
+}
+
+// input bit counter of the current report ID, NULL when out of room
+static uint32_t *idBits(HidWalker *w) {
+  for (uint32_t i = 0; i != w->idCount; ++i) {
+    if (w->ids[i] == w->in.g.id) {
+      return w->bits + i;
+    }
+  }
+  if (w->idCount == HID_IDS) {
+    return NULL;
+  }
+  w->ids[w->idCount] = w->in.g.id;
+  w->bits[w->idCount] = w->in.hasIds ? 8 : 0;
+  return w->bits + w->idCount++;
+}
+
+static int32_t signedData(uint32_t data, uint32_t len) {
+  if (len == 1) {
+    return (int8_t)data;
+  } else if (len == 2) {
+    return (int16_t)data;
+  }
+  return (int32_t)data;
+}
+
+static int hasReportIds(const volatile uint8_t *hid, uint32_t hidlen) {
+  for (uint32_t i = 0; i < hidlen; ++i) {
+    if (hid[i] == LONG_ITEM) {
+      // long item: size byte, tag byte, data; nothing we use
+      if (i + 1 >= hidlen) {
+        break;
+      }
+      i += 2 + (uint32_t)hid[i + 1];
+    } else if ((hid[i] >> 2) == REPORTID) {
+      return 1;
+    } else {
+      i += (hid[i] & 3) == 3 ? 4 : (hid[i] & 3);
+    }
+  }
+  return 0;
+}
+
+void hidWalk(const volatile uint8_t *hid, uint32_t hidlen, HidInputFn fn,
+             void *ctx) {
+  HidWalker w;
+  memset(&w, 0, sizeof(w));
+  w.in.hasIds = hasReportIds(hid, hidlen);
+
+  for (uint32_t i = 0; i < hidlen;) {
+    const uint8_t cmd = hid[i];
+    if (cmd == LONG_ITEM) {
+      if (i + 1 >= hidlen) {
+        break;
+      }
+      i += 3 + (uint32_t)hid[i + 1];
+      continue;
+    }
+    const uint32_t datalen = (cmd & 3) == 3 ? 4 : (cmd & 3);
+    i += 1;
+    if (datalen > hidlen - i) {
+      break; // truncated item
+    }
+    uint32_t data = 0;
+    for (uint32_t mi = 0; mi != datalen; ++mi) {
+      data |= ((uint32_t)hid[mi + i]) << (mi << 3);
+    }
+    i += datalen;
+
+    HidInput *in = &w.in;
+    int mainItem = 0;
+    switch (cmd >> 2) {
+    case USAGE_PAGE:
+      in->g.page = data & 0xffff;
+      break;
+    case LOGICAL_MINIMUM:
+      in->g.logMin = signedData(data, datalen);
+      break;
+    case LOGICAL_MAXIMUM:
+      // unsigned unless the minimum is negative: many descriptors send 255
+      // as a 1-byte 0xff
+      in->g.logMax =
+          in->g.logMin < 0 ? signedData(data, datalen) : (int32_t)data;
+      break;
+    case REPORT_SIZE:
+      in->g.size = data > 0xff ? 0xff : data;
+      break;
+    case REPORT_COUNT:
+      in->g.count = data > 0xffff ? 0xffff : data;
+      break;
+    case REPORTID:
+      in->g.id = data;
+      break;
+    case PUSH:
+      if (w.depth < HID_STACK) {
+        w.stack[w.depth] = in->g;
+      }
+      ++w.depth;
+      break;
+    case POP:
+      if (w.depth > 0) {
+        --w.depth;
+        if (w.depth < HID_STACK) {
+          in->g = w.stack[w.depth];
+        }
+      }
+      break;
+    case USAGE:
+      if (in->usageCount < HID_USAGES) {
+        in->usages[in->usageCount++] = fullUsage(&w, data, datalen);
+      }
+      break;
+    case USAGE_MINIMUM:
+      in->usageMin = fullUsage(&w, data, datalen);
+      w.rangeItems |= 1;
+      break;
+    case USAGE_MAXIMUM:
+      in->usageMax = fullUsage(&w, data, datalen);
+      w.rangeItems |= 2;
+      break;
+    case COLLECTION:
+      rangeDone(&w);
+      ++w.level;
+      if (data == Application) {
+        in->appUsage = hidUsage(in, 0);
+        w.appLevel = w.level;
+      }
+      mainItem = 1;
+      break;
+    case END_COLLECTION:
+      if (w.level > 0) {
+        if (w.appLevel == w.level) {
+          in->appUsage = 0;
+          w.appLevel = 0;
+        }
+        --w.level;
+      }
+      mainItem = 1;
+      break;
+    case INPUT: {
+      uint32_t *bits = idBits(&w);
+      rangeDone(&w);
+      if (bits) {
+        in->flags = data;
+        in->offset = *bits;
+        fn(ctx, in);
+        if (*bits < 0x10000) { // past any offset we can store
+          *bits += in->g.count * in->g.size;
+        }
+      }
+      mainItem = 1;
+    } break;
+    case OUTPUT:
+    case FEATURE:
+      mainItem = 1;
+      break;
+    }
+    if (mainItem) {
+      // local items only apply to the next main item
+      in->usageCount = 0;
+      in->usageMin = 0;
+      in->usageMax = 0;
+      in->haveRange = 0;
+      w.rangeItems = 0;
+    }
+  }
+}
+
+uint32_t hidUsage(const HidInput *in, uint32_t i) {
+  if (i < in->usageCount) {
+    return in->usages[i];
+  }
+  if (in->haveRange) {
+    const uint32_t j = i - in->usageCount;
+    return j <= in->usageMax - in->usageMin ? in->usageMin + j : in->usageMax;
+  }
+  return in->usageCount ? in->usages[in->usageCount - 1] : 0;
+}
+
+uint32_t hidUsageSpan(const HidInput *in) {
+  uint32_t n = in->usageCount;
+  if (in->haveRange) {
+    const uint32_t range = in->usageMax - in->usageMin;
+    n = range >= in->g.count ? in->g.count : n + range + 1;
+  }
+  return n < in->g.count ? n : in->g.count;
+}
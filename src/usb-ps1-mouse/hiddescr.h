@@ -0,0 +1,60 @@
+#ifndef HIDDESCR_H
+#define HIDDESCR_H
+
+#include <stdint.h>
+
+// HID report descriptor walker. Tracks global items (with push/pop), local
+// usages, collections and the bit offset of every input field in its report,
+// and hands each Input main item to a callback.
+
+#define HID_USAGES 16 // explicit usages per main item
+
+// extended usages: page in the high 16 bits
+#define HID_PAGE_DESKTOP 0x01
+#define HID_PAGE_KEYBOARD 0x07
+#define HID_PAGE_BUTTON 0x09
+#define HID_PAGE_CONSUMER 0x0C
+#define HID_USAGE_MOUSE 0x00010002
+#define HID_USAGE_X 0x00010030
+#define HID_USAGE_Y 0x00010031
+#define HID_USAGE_WHEEL 0x00010038
+#define HID_USAGE_BUTTON1 0x00090001
+
+#define HID_INPUT_CONST 0x01
+#define HID_INPUT_VAR 0x02
+
+typedef struct {
+  uint32_t page;
+  int32_t logMin;
+  int32_t logMax;
+  uint32_t size;  // bits per value, at most 0xff
+  uint32_t count; // values, at most 0xffff
+  uint8_t id;
+} HidGlobals;
+
+typedef struct {
+  HidGlobals g;
+  uint32_t flags;    // Input item data
+  uint32_t offset;   // bit offset in the report, report ID included
+  uint32_t appUsage; // usage of the enclosing application collection
+  uint8_t hasIds;    // reports of this descriptor start with their ID
+  uint8_t haveRange;
+  uint32_t usageMin;
+  uint32_t usageMax;
+  uint32_t usageCount;
+  uint32_t usages[HID_USAGES];
+} HidInput;
+
+typedef void (*HidInputFn)(void *ctx, const HidInput *in);
+
+void hidWalk(const volatile uint8_t *descr, uint32_t descrLen, HidInputFn fn,
+             void *ctx);
+
+// usage of value i: explicit usages first, then the usage range; values past
+// the end repeat the last usage
+uint32_t hidUsage(const HidInput *in, uint32_t i);
+
+// number of values with a usage of their own, at most in->g.count
+uint32_t hidUsageSpan(const HidInput *in);
+
+#endif // HIDDESCR_H
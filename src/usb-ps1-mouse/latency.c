@@ -0,0 +1,21 @@
+#include "latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void histReset(Hist *h, uint8_t shift) {
+  memset(h, 0, sizeof(*h));
+  h->shift = shift;
+}
+
+void histPrint(const char *name, const Hist *h) {
+  printf(",\"%s_unit_us\":\"%lu\",\"%s_max_us\":\"%lu\",\"%s\":\"", name,
+         1ul << h->shift, name, (unsigned long)h->max, name);
+  for (int i = 0; i != HIST_BUCKETS; ++i) {
+    if (i != 0) {
+      printf(" ");
+    }
+    printf("%lu", (unsigned long)h->bucket[i]);
+  }
+  printf("\"");
+}
@@ -0,0 +1,35 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#define HIST_BUCKETS 32
+
+// Fixed-bucket histogram of microsecond values. Bucket i counts values in
+// [i << shift, (i + 1) << shift), the last bucket also everything above.
+// Single writer; a reader on the other core may see it mid-update.
+typedef struct {
+  uint8_t shift;
+  uint32_t max;
+  uint32_t count;
+  uint32_t bucket[HIST_BUCKETS];
+} Hist;
+
+static inline void histAdd(Hist *h, uint32_t us) {
+  uint32_t i = us >> h->shift;
+  if (i >= HIST_BUCKETS) {
+    i = HIST_BUCKETS - 1;
+  }
+  ++h->bucket[i];
+  ++h->count;
+  if (us > h->max) {
+    h->max = us;
+  }
+}
+
+void histReset(Hist *h, uint8_t shift);
+
+// prints ,"<name>_unit_us":"..","<name>_max_us":"..","<name>":"c0 c1 .."
+void histPrint(const char *name, const Hist *h);
+
+#endif // LATENCY_H
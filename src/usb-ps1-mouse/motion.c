@@ -0,0 +1,68 @@
+#include "motion.h"
+
+#include "sram.h"
+
+#define INTERVAL_MIN_US 125 // 8 kHz reports
+
+static uint16_t gainMul(uint32_t gain, uint32_t m) {
+  const uint32_t g = gain * m / MOTION_GAIN_1X;
+  return g > UINT16_MAX ? UINT16_MAX : g;
+}
+
+void motionCurveBuild(MotionCurve *c, const MotionConf *conf, uint32_t gain) {
+  const uint32_t gx = conf->gainX ? conf->gainX : gain;
+  const uint32_t gy = conf->gainY ? conf->gainY : gx;
+  uint32_t cap = conf->accelMax ? conf->accelMax : MOTION_ACCEL_MAX_DEFAULT;
+  cap *= MOTION_GAIN_1X / 8;
+  if (cap < MOTION_GAIN_1X) {
+    cap = MOTION_GAIN_1X;
+  }
+  for (uint32_t i = 0; i != MOTION_SPEEDS; ++i) {
+    // accel / 16 per count/ms, at i / 8 count per ms
+    uint32_t m = MOTION_GAIN_1X + conf->accel * i * MOTION_GAIN_1X / 128;
+    if (m > cap) {
+      m = cap;
+    }
+    c->gain[0][i] = gainMul(gx, m);
+    c->gain[1][i] = gainMul(gy, m);
+  }
+  // mean gain in 1/256, times 8 for 1/8 counts and 1000 for per ms
+  c->speedScale = (gx + gy) * 125 / 8 + 1; // not 0 for a zero gain
+  c->magnitudeMax = UINT32_MAX / c->speedScale;
+  const uint8_t smooth =
+      conf->smooth > MOTION_SMOOTH_MAX ? MOTION_SMOOTH_MAX : conf->smooth;
+  c->hold = smooth * MOTION_GAIN_1X;
+}
+
+static inline int32_t SRAM_FUNC(axisApply)(MotionAxis *a, int32_t d,
+                                           uint32_t gain, int32_t hold) {
+  const int32_t t = d * (int32_t)gain + a->rem;
+  int32_t out = t >> 8; // rounds down, rem stays 0-255 unless held
+  if (out * a->dir < 0 && t >= -hold && t <= hold) {
+    out = 0; // a small turn back: jitter until it grows or cancels out
+  }
+  a->rem = t - out * MOTION_GAIN_1X;
+  if (out) {
+    a->dir = out > 0 ? 1 : -1;
+  }
+  return out;
+}
+
+void SRAM_FUNC(motionApply)(const MotionCurve *c, MotionAxis ax[2],
+                            const int16_t d[2], uint32_t intervalUs,
+                            int32_t out[2]) {
+  uint32_t speed = 0;
+  if (intervalUs) {
+    const uint32_t x = d[0] < 0 ? -d[0] : d[0];
+    const uint32_t y = d[1] < 0 ? -d[1] : d[1];
+    // max + min / 2 for the length
+    uint32_t mag = x > y ? x + y / 2 : y + x / 2;
+    mag = mag > c->magnitudeMax ? c->magnitudeMax : mag;
+    const uint32_t us = intervalUs < INTERVAL_MIN_US ? INTERVAL_MIN_US
+                                                     : intervalUs;
+    speed = mag * c->speedScale / us;
+    speed = speed >= MOTION_SPEEDS ? MOTION_SPEEDS - 1 : speed;
+  }
+  out[0] = axisApply(ax, d[0], c->gain[0][speed], c->hold);
+  out[1] = axisApply(ax + 1, d[1], c->gain[1][speed], c->hold);
+}
@@ -0,0 +1,49 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stdint.h>
+
+// Mouse motion as a profile wants it: a sensitivity per axis, acceleration
+// over pointer speed and a filter for sensor jitter. There is no FPU, so
+// gains are in 1/256, looked up by speed in a table built when the profile
+// becomes active, and the fraction of a count a report leaves over is
+// carried to the next one.
+
+#define MOTION_GAIN_1X 256
+#define MOTION_SPEEDS 64          // table entries, 1/8 count per ms each
+#define MOTION_ACCEL_MAX_DEFAULT 32 // 4x, in 1/8
+#define MOTION_SMOOTH_MAX 15
+
+// Stored in profiles; all zero is plain scaling by the profile speed.
+typedef struct {
+  uint16_t gainX;   // sensitivity in 1/256, 0 = the profile speed
+  uint16_t gainY;   // 0 = as gainX
+  uint8_t accel;    // gain added per count/ms of speed, in 1/16
+  uint8_t accelMax; // gain the acceleration stops at in 1/8, 0 = 4x
+  uint8_t smooth;   // counts a turn back is held as jitter, 0 = off
+  uint8_t reserved;
+} MotionConf;
+
+// Speed is that of the scaled motion, before acceleration, in 1/8 count per
+// ms; anything faster gets the last entry.
+typedef struct {
+  uint16_t gain[2][MOTION_SPEEDS]; // by axis and speed, in 1/256
+  uint32_t speedScale;   // report magnitude times this over the interval
+  uint32_t magnitudeMax; // that still fits 32 bits
+  int32_t hold;        // smooth in 1/256 count
+} MotionCurve;
+
+typedef struct {
+  int32_t rem; // motion not passed on yet, in 1/256 count
+  int8_t dir;  // of the last count passed on
+} MotionAxis;
+
+// gain is the sensitivity to use where conf has none, in 1/256
+void motionCurveBuild(MotionCurve *c, const MotionConf *conf, uint32_t gain);
+
+// One report of d[0], d[1] counts, intervalUs after the previous one (0 =
+// unknown, taken as slow). out gets the counts to pass on.
+void motionApply(const MotionCurve *c, MotionAxis ax[2], const int16_t d[2],
+                 uint32_t intervalUs, int32_t out[2]);
+
+#endif // MOTION_H
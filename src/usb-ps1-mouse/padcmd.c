@@ -0,0 +1,113 @@
+#include "padcmd.h"
+
+#include <string.h>
+
+#include "sram.h"
+
+// modes a command is answered in
+#define IN_NORMAL 0x01
+#define IN_CONFIG 0x02
+
+typedef struct {
+  uint8_t modes;
+  uint8_t reply[2]; // by parameter: anything but 1, 1
+} PadCommand;
+
+// indexed by cmd - 0x40; unknown commands get zeros in config mode like on
+// a DualShock
+static const PadCommand SRAM_TABLE("PAD_COMMANDS") PAD_COMMANDS[16] = {
+    [0x0] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+    [0x1] = {IN_CONFIG, {PAD_REPLY_QUERY, PAD_REPLY_QUERY}},
+    [0x2] = {IN_NORMAL | IN_CONFIG, {PAD_REPLY_POLL, PAD_REPLY_POLL}},
+    [0x3] = {IN_NORMAL | IN_CONFIG, {PAD_REPLY_POLL, PAD_REPLY_POLL}},
+    [0x4] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+    [0x5] = {IN_CONFIG, {PAD_REPLY_STATUS, PAD_REPLY_STATUS}},
+    [0x6] = {IN_CONFIG, {PAD_REPLY_ACT0, PAD_REPLY_ACT1}},
+    [0x7] = {IN_CONFIG, {PAD_REPLY_COMB, PAD_REPLY_COMB}},
+    [0x8] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+    [0x9] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+    [0xA] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+    [0xB] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+    [0xC] = {IN_CONFIG, {PAD_REPLY_MODE0, PAD_REPLY_MODE1}},
+    [0xD] = {IN_CONFIG, {PAD_REPLY_MOTOR, PAD_REPLY_MOTOR}},
+    [0xE] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+    [0xF] = {IN_CONFIG, {PAD_REPLY_ZERO, PAD_REPLY_ZERO}},
+};
+
+// reply bytes after the 0x5A of the fixed replies
+static const uint8_t SRAM_TABLE("PAD_FIXED")
+    PAD_FIXED[PAD_REPLIES][PAD_REPLY_SIZE - 2] = {
+    [PAD_REPLY_ACT0] = {0x00, 0x00, 0x01, 0x02, 0x00, 0x0A},
+    [PAD_REPLY_ACT1] = {0x00, 0x00, 0x01, 0x01, 0x01, 0x14},
+    [PAD_REPLY_COMB] = {0x00, 0x00, 0x02, 0x00, 0x01, 0x00},
+    [PAD_REPLY_MODE0] = {0x00, 0x00, 0x00, 0x04, 0x00, 0x00},
+    [PAD_REPLY_MODE1] = {0x00, 0x00, 0x00, 0x07, 0x00, 0x00},
+};
+
+// rebuild the replies that depend on the mode
+static void SRAM_FUNC(padModeReplies)(PadMode *m) {
+  for (uint32_t i = 0; i != PAD_REPLIES; ++i) {
+    m->replies[i][0] = PAD_ID_CONFIG;
+    m->replies[i][1] = 0x5A;
+    memcpy(m->replies[i] + 2, PAD_FIXED[i], PAD_REPLY_SIZE - 2);
+  }
+  if (m->analog) {
+    uint8_t *q = m->replies[PAD_REPLY_QUERY] + 2;
+    q[0] = 0xFF;
+    q[1] = 0xFF;
+    q[2] = 0x03;
+  }
+  uint8_t *st = m->replies[PAD_REPLY_STATUS] + 2;
+  st[0] = 0x01; // DualShock (SCPH-1200), 0x03 is a DualShock 2
+  st[1] = 0x02;
+  st[2] = m->analog; // mode LED
+  st[3] = 0x02;
+  st[4] = 0x01;
+  memcpy(m->replies[PAD_REPLY_MOTOR] + 2, m->motor, PAD_PARAMS);
+}
+
+void SRAM_FUNC(padModeInit)(PadMode *m) {
+  m->config = false;
+  m->analog = true;
+  m->locked = false;
+  memset(m->motor, 0xFF, sizeof(m->motor));
+  padModeReplies(m);
+}
+
+int SRAM_FUNC(padReply)(const PadMode *m, uint8_t cmd, uint8_t param) {
+  if ((cmd & 0xF0) != 0x40) {
+    return -1;
+  }
+  const PadCommand *c = PAD_COMMANDS + (cmd & 0x0F);
+  if (!(c->modes & (m->config ? IN_CONFIG : IN_NORMAL))) {
+    return -1;
+  }
+  if (m->config && cmd == PAD_CMD_CONFIG) {
+    return PAD_REPLY_ZERO; // in config mode it only leaves it
+  }
+  return c->reply[param == 1];
+}
+
+void SRAM_FUNC(padCommandDone)(PadMode *m, uint8_t cmd,
+                              const uint8_t params[PAD_PARAMS]) {
+  if (cmd == PAD_CMD_CONFIG) {
+    if (params[0] <= 1) {
+      m->config = params[0];
+    }
+    return;
+  }
+  if (!m->config) {
+    return;
+  }
+  if (cmd == 0x44) {
+    if (params[0] <= 1) {
+      m->analog = params[0];
+    }
+    m->locked = params[1] == 0x03;
+  } else if (cmd == 0x4D) {
+    memcpy(m->motor, params, PAD_PARAMS);
+  } else {
+    return;
+  }
+  padModeReplies(m);
+}
@@ -0,0 +1,64 @@
+#ifndef PADCMD_H
+#define PADCMD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Commands of the analog pad (0x40-0x4F in byte 1). Replies are 8 bytes, the
+// ID for byte 1 first, and are all built ahead of the transaction: the reply
+// is picked when byte 1 arrives, and for commands taking a parameter again
+// when byte 3 does. Both choices only affect bytes that are still to come.
+
+#define PAD_ID_DIGITAL 0x41
+#define PAD_ID_ANALOG 0x73
+#define PAD_ID_CONFIG 0xF3
+
+#define PAD_CMD_POLL 0x42
+#define PAD_CMD_CONFIG 0x43
+
+#define PAD_REPLY_SIZE 8 // reply bytes after byte 0
+#define PAD_PARAMS 6     // command bytes 3-8
+
+// replies kept in PadMode.replies
+enum {
+  PAD_REPLY_ZERO,   // acknowledged, nothing to report
+  PAD_REPLY_QUERY,  // 0x41: buttons reported in analog mode
+  PAD_REPLY_STATUS, // 0x45: model and mode LED
+  PAD_REPLY_ACT0,   // 0x46: actuator info, param 0
+  PAD_REPLY_ACT1,   // 0x46: param 1
+  PAD_REPLY_COMB,   // 0x47
+  PAD_REPLY_MODE0,  // 0x4C: actuator modes, param 0
+  PAD_REPLY_MODE1,  // 0x4C: param 1
+  PAD_REPLY_MOTOR,  // 0x4D: the previous motor map
+  PAD_REPLIES,
+  PAD_REPLY_POLL = 0xff // buttons and sticks, from the pad frame
+};
+
+// state of the pad as set by the console, core0
+typedef struct {
+  bool config; // config mode, answers 0x40-0x4F with ID 0xF3
+  bool analog; // 0x73 rather than 0x41
+  bool locked; // mode set by 0x44 and not to be changed by the user
+  uint8_t motor[PAD_PARAMS];
+  uint8_t replies[PAD_REPLIES][PAD_REPLY_SIZE];
+} PadMode;
+
+// power-up state: analog, not in config mode
+void padModeInit(PadMode *m);
+
+// ID byte of the next reply
+static inline uint8_t padId(const PadMode *m) {
+  return m->config ? PAD_ID_CONFIG
+                   : m->analog ? PAD_ID_ANALOG : PAD_ID_DIGITAL;
+}
+
+// Reply to command cmd with parameter param (byte 3, 0 before it arrives):
+// an index into m->replies, PAD_REPLY_POLL, or -1 if the command is not
+// answered in the current mode.
+int padReply(const PadMode *m, uint8_t cmd, uint8_t param);
+
+// Applies a completed command; params are command bytes 3-8.
+void padCommandDone(PadMode *m, uint8_t cmd,
+                    const uint8_t params[PAD_PARAMS]);
+
+#endif // PADCMD_H
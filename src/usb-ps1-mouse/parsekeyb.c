@@ -0,0 +1,244 @@
+#include "parsekeyb.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hiddescr.h"
+#include "sram.h"
+
+// keyboard page usages reporting an error instead of keys
+#define KEY_ERROR_ROLLOVER 0x01
+#define KEY_ERROR_UNDEFINED 0x03
+
+typedef struct {
+  uint8_t id;
+  uint8_t count;
+  KeybField fields[KEYB_FIELDS];
+} KeybPos;
+
+typedef struct {
+  uint8_t hasIds;
+  uint32_t reportCount;
+  KeybPos reports[KEYB_REPORTS];
+} KeybCompiler;
+
+// keyboard page usage standing for a consumer control usage, 0 = none
+static uint8_t consumerKey(uint32_t usage) {
+  switch (usage) {
+  case 0xE2: // Mute
+    return 0x7F;
+  case 0xE9: // Volume Increment
+    return 0x80;
+  case 0xEA: // Volume Decrement
+    return 0x81;
+  default:
+    return 0;
+  }
+}
+
+// keyboard page usage of an extended usage, 0 = not a key
+static uint8_t keyUsage(uint32_t usage) {
+  const uint32_t page = usage >> 16;
+  usage &= 0xffff;
+  if (page == HID_PAGE_KEYBOARD) {
+    return usage > KEY_ERROR_UNDEFINED && usage < 0x100 ? usage : 0;
+  } else if (page == HID_PAGE_CONSUMER) {
+    return consumerKey(usage);
+  }
+  return 0;
+}
+
+static KeybPos *reportPos(KeybCompiler *c, uint8_t id) {
+  for (uint32_t i = 0; i != c->reportCount; ++i) {
+    if (c->reports[i].id == id) {
+      return c->reports + i;
+    }
+  }
+  if (c->reportCount == KEYB_REPORTS) {
+    return NULL;
+  }
+  KeybPos *r = c->reports + c->reportCount++;
+  memset(r, 0, sizeof(*r));
+  r->id = id;
+  return r;
+}
+
+static KeybField *addField(KeybCompiler *c, uint8_t id) {
+  KeybPos *r = reportPos(c, id);
+  if (!r || r->count == KEYB_FIELDS) {
+    return NULL;
+  }
+  KeybField *f = r->fields + r->count++;
+  memset(f, 0, sizeof(*f));
+  return f;
+}
+
+// variable 1-bit values: runs of consecutive keys become bitmap fields
+static void keybBitmap(KeybCompiler *c, const HidInput *in) {
+  KeybField *f = NULL;
+  const uint32_t n = hidUsageSpan(in);
+  for (uint32_t i = 0; i != n; ++i) {
+    const uint8_t key = keyUsage(hidUsage(in, i));
+    const uint32_t at = in->offset + i;
+    if (key == 0 || at >= 0xffff) {
+      f = NULL;
+      continue;
+    }
+    if (f && f->offset + f->count == at && f->usage + f->count == key) {
+      ++f->count;
+    } else if ((f = addField(c, in->g.id))) {
+      f->kind = KEY_BITMAP;
+      f->usage = key;
+      f->offset = at;
+      f->count = 1;
+    }
+  }
+}
+
+// array: the values are indices into the usage range
+static void keybArray(KeybCompiler *c, const HidInput *in) {
+  const uint32_t page = in->usageMin >> 16;
+  if (!in->haveRange || in->usageCount ||
+      (page != HID_PAGE_KEYBOARD && page != HID_PAGE_CONSUMER) ||
+      page != in->usageMax >> 16 || in->g.size == 0 || in->g.size > 16 ||
+      in->g.logMin < 0 || in->g.logMax < in->g.logMin ||
+      in->g.logMax > 0xffff ||
+      in->offset + in->g.count * in->g.size > 0xffff) {
+    return;
+  }
+  KeybField *f = addField(c, in->g.id);
+  if (f) {
+    f->kind = KEY_ARRAY;
+    f->size = in->g.size;
+    f->consumer = page == HID_PAGE_CONSUMER;
+    f->count = in->g.count;
+    f->offset = in->offset;
+    f->usageMin = in->usageMin & 0xffff;
+    f->logMin = in->g.logMin;
+    // values past the usage range have no usage
+    const uint32_t last = in->g.logMin + (in->usageMax - in->usageMin);
+    const uint32_t logMax = in->g.logMax;
+    f->logMax = last < logMax ? last : logMax;
+  }
+}
+
+static void keybInput(void *ctx, const HidInput *in) {
+  KeybCompiler *c = ctx;
+  c->hasIds = in->hasIds;
+  if (in->flags & HID_INPUT_CONST) {
+    return;
+  }
+  if (in->flags & HID_INPUT_VAR) {
+    if (in->g.size == 1) {
+      keybBitmap(c, in);
+    }
+  } else {
+    keybArray(c, in);
+  }
+}
+
+void parseKeybDescr(const volatile uint8_t *hid, uint32_t hidlen,
+                    KeybConf *conf) {
+  KeybCompiler c;
+  c.hasIds = 0;
+  c.reportCount = 0;
+  hidWalk(hid, hidlen, keybInput, &c);
+
+  conf->hasIds = c.hasIds;
+  conf->count = 0;
+  memset(conf->byId, KEYB_NO_REPORT, sizeof(conf->byId));
+  for (uint32_t r = 0; r != c.reportCount; ++r) {
+    const KeybPos *pos = c.reports + r;
+    if (pos->count == 0 || (c.hasIds ? !pos->id : pos->id)) {
+      continue;
+    }
+    KeybReport *report = conf->reports + conf->count;
+    conf->byId[pos->id] = conf->count++;
+    report->count = pos->count;
+    report->dataLen = 0;
+    for (uint32_t i = 0; i != pos->count; ++i) {
+      const KeybField *f = pos->fields + i;
+      const uint32_t bits =
+          f->kind == KEY_ARRAY ? f->count * f->size : f->count;
+      const uint32_t end = (f->offset + bits + 7) >> 3;
+      if (end > report->dataLen) {
+        report->dataLen = end;
+      }
+      report->fields[i] = *f;
+    }
+  }
+}
+
+// size bits at bit offset `at`, size at most 16; data must cover them
+static inline uint32_t SRAM_FUNC(readBits)(const uint8_t *data, uint32_t at,
+                                           uint32_t size) {
+  const uint8_t *p = data + (at >> 3);
+  const uint32_t shift = at & 7;
+  uint32_t w = p[0];
+  for (uint32_t i = 1; i < (shift + size + 7) >> 3; ++i) {
+    w |= (uint32_t)p[i] << (i * 8);
+  }
+  return (w >> shift) & ((1u << size) - 1);
+}
+
+static inline void SRAM_FUNC(setKeys)(uint32_t *keys, uint32_t key,
+                                      uint32_t bits) {
+  const uint32_t shift = key & 31;
+  keys[key >> 5] |= bits << shift;
+  if (shift && key < 224) {
+    keys[(key >> 5) + 1] |= bits >> (32 - shift);
+  }
+}
+
+int SRAM_FUNC(parseKeybData)(const uint8_t *data, uint32_t dataLen,
+                             const KeybConf *conf, KeyBits keys[KEYB_REPORTS]) {
+  const int ok = 0;
+  const int err = 1;
+  uint8_t index = 0;
+  if (conf->hasIds) {
+    if (dataLen == 0) {
+      return err;
+    }
+    index = conf->byId[data[0]];
+  }
+  if (index >= conf->count) {
+    return err;
+  }
+  const KeybReport *r = conf->reports + index;
+  if (dataLen < r->dataLen) {
+    return err;
+  }
+
+  KeyBits tmp = {0};
+  for (uint32_t i = 0; i != r->count; ++i) {
+    const KeybField *f = r->fields + i;
+    if (f->kind == KEY_BITMAP) {
+      // a byte at a time
+      for (uint32_t j = 0; j < f->count; j += 8) {
+        const uint32_t n = f->count - j < 8 ? f->count - j : 8;
+        setKeys(tmp, f->usage + j, readBits(data, f->offset + j, n));
+      }
+      continue;
+    }
+    for (uint32_t j = 0; j != f->count; ++j) {
+      const uint32_t v = readBits(data, f->offset + j * f->size, f->size);
+      if (v < f->logMin || v > f->logMax) {
+        continue; // no key
+      }
+      const uint32_t usage = f->usageMin + v - f->logMin;
+      uint32_t key;
+      if (f->consumer) {
+        key = consumerKey(usage);
+      } else if (usage >= KEY_ERROR_ROLLOVER && usage <= KEY_ERROR_UNDEFINED) {
+        return err; // too many keys down, the state is unknown
+      } else {
+        key = usage < 0x100 ? usage : 0;
+      }
+      if (key) {
+        tmp[key >> 5] |= 1u << (key & 31);
+      }
+    }
+  }
+  memcpy(keys[index], tmp, sizeof(tmp));
+  return ok;
+}
@@ -0,0 +1,52 @@
+#ifndef PARSEKEYB_H
+#define PARSEKEYB_H
+
+#include <stdint.h>
+
+#define KEY_BITMAP 1 // one bit per key, bit 0 is keyboard usage `usage`
+#define KEY_ARRAY 2  // each value selects usage usageMin + value - logMin
+
+// one key field of an input report, compiled by parseKeybDescr()
+typedef struct {
+  uint8_t kind;
+  uint8_t size;      // KEY_ARRAY: bits per value, at most 16
+  uint8_t consumer;  // KEY_ARRAY: values are consumer page usages
+  uint8_t usage;     // KEY_BITMAP: keyboard usage of the first bit
+  uint16_t count;    // bits or values
+  uint16_t offset;   // in bits, report ID included
+  uint16_t usageMin; // KEY_ARRAY
+  uint16_t logMin;
+  uint16_t logMax;
+} KeybField;
+
+#define KEYB_FIELDS 8 // key fields kept per report
+
+typedef struct {
+  uint8_t count;    // entries used in fields[]
+  uint16_t dataLen; // report bytes covered by the fields
+  KeybField fields[KEYB_FIELDS];
+} KeybReport;
+
+#define KEYB_REPORTS 4 // key reports kept per interface
+#define KEYB_NO_REPORT 0xff
+
+// Compiled report descriptor, indexed like MouseConf. Keyboard page keys and
+// the consumer keys with a keyboard page equivalent are kept.
+typedef struct {
+  uint8_t hasIds;
+  uint8_t count; // entries used in reports[], 0 = no usable key report
+  uint8_t byId[256];
+  KeybReport reports[KEYB_REPORTS];
+} KeybConf;
+
+// pressed keys by keyboard usage, one bitmap per report of a KeybConf
+typedef uint32_t KeyBits[8];
+
+void parseKeybDescr(const volatile uint8_t *descr, uint32_t descrLen,
+                    KeybConf *conf);
+// Replaces the bitmap of the report in data. On error, rollover included,
+// keys is left as it was.
+int parseKeybData(const uint8_t *data, uint32_t dataLen, const KeybConf *conf,
+                  KeyBits keys[KEYB_REPORTS]);
+
+#endif // PARSEKEYB_H
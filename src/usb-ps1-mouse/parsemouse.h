@@ -3,21 +3,56 @@
 
 #include <stdint.h>
 
+#define FIELD_NONE 0 // field not present, reads as 0
+#define FIELD_S8 1   // byte aligned 8-bit
+#define FIELD_S16 2  // byte aligned 16-bit little endian
+#define FIELD_BITS 3 // anything else up to 16 bits
+
+// extraction plan for one report field, compiled by parseMouseDescr()
+typedef struct {
+  uint8_t kind;
+  uint8_t len;   // bytes spanned by the field
+  uint8_t lsh;   // FIELD_BITS: value = (int32_t)(bytes << lsh) >> rsh
+  uint8_t rsh;
+  uint16_t byte; // first byte of the field
+} MouseField;
+
+// fields of one mouse input report
+typedef struct {
+  MouseField btn;
+  MouseField x;
+  MouseField y;
+  MouseField wheel;
+  uint16_t dataLen; // report bytes covered by the fields
+} MouseReport;
+
+#define MOUSE_REPORTS 4 // mouse input reports kept per interface
+#define MOUSE_NO_REPORT 0xff
+
+// Compiled report descriptor. Without report IDs only reports[0] is used,
+// otherwise byId maps the first byte of a report to its entry.
 typedef struct {
-  uint8_t isId;
-  uint8_t id;
-  uint8_t btnI;
-  uint8_t xI;
-  uint8_t xSize; // 1 or 2
-  uint8_t yI;
-  uint8_t ySize;
-  uint8_t wheelI;
-  uint8_t wheelSize;
+  uint8_t hasIds;
+  uint8_t count; // entries used in reports[], 0 = no usable mouse report
+  uint8_t byId[256];
+  MouseReport reports[MOUSE_REPORTS];
 } MouseConf;
 
+// MouseConf without the byId table, as kept in the device cache (profile.h)
+typedef struct {
+  uint8_t hasIds;
+  uint8_t count;
+  uint8_t ids[MOUSE_REPORTS]; // report ID of each entry
+  MouseReport reports[MOUSE_REPORTS];
+} MousePlan;
+
 void parseMouseDescr(const volatile uint8_t *descr, uint32_t descrLen,
                      MouseConf *conf);
+void mousePlanPack(const MouseConf *conf, MousePlan *plan);
+// Returns non-zero, conf unchanged, if the plan is not one parseMouseDescr()
+// could have made.
+int mousePlanUnpack(const MousePlan *plan, MouseConf *conf);
 int parseMouseData(const uint8_t *data, uint32_t dataLen, const MouseConf *conf,
-                   int8_t o[4]);
+                   int16_t o[4]);
 
 #endif // PARSEMOUSE_H
@@ -0,0 +1,52 @@
+#include "polltrack.h"
+
+#define SKIPPED_MAX 4 // periods one interval may span and still count
+#define SILENT_MAX 4  // periods without a poll before predictions stop
+
+// take one interval as the period, if plausible, and start counting again
+static void pollTrackRestart(PollTrack *t, uint32_t interval) {
+  const bool plausible =
+      interval >= POLL_TRACK_MIN_US && interval <= POLL_TRACK_MAX_US;
+  t->periodQ4 = plausible ? interval << 4 : 0;
+  t->hits = 0;
+}
+
+void pollTrackAdd(PollTrack *t, uint32_t us) {
+  const uint32_t interval = us - t->lastUs;
+  const bool started = t->started;
+  t->lastUs = us;
+  t->started = true;
+  if (!started) {
+    return;
+  }
+  if (t->periodQ4 == 0) {
+    pollTrackRestart(t, interval);
+    return;
+  }
+  // whole periods the interval spans, rounded
+  const uint32_t q4 = interval << 4;
+  const uint32_t n = (q4 + t->periodQ4 / 2) / t->periodQ4;
+  const int32_t err = (int32_t)(q4 - n * t->periodQ4);
+  const int32_t tol = t->periodQ4 / 32; // about 500 us at 60 Hz
+  if (n == 0 || n > SKIPPED_MAX || err > tol || err < -tol) {
+    pollTrackRestart(t, interval);
+    return;
+  }
+  t->periodQ4 += err / (int32_t)(8 * n);
+  if (t->hits != UINT8_MAX) {
+    ++t->hits;
+  }
+}
+
+bool pollTrackNext(const PollTrack *t, uint32_t nowUs, uint32_t *nextUs) {
+  if (t->hits < POLL_TRACK_LOCK) {
+    return false;
+  }
+  const uint32_t since = nowUs - t->lastUs;
+  const uint32_t n = ((uint64_t)since << 4) / t->periodQ4 + 1;
+  if (n > SILENT_MAX) {
+    return false;
+  }
+  *nextUs = t->lastUs + (uint32_t)(((uint64_t)n * t->periodQ4) >> 4);
+  return true;
+}
@@ -0,0 +1,30 @@
+#ifndef POLLTRACK_H
+#define POLLTRACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Period and phase of the console's polls, learnt from the times they start.
+// The period is followed with a slow filter once polls keep to it; a frame
+// the console skips counts as two periods, anything else starts over.
+
+#define POLL_TRACK_MIN_US 4000  // shortest plausible poll period
+#define POLL_TRACK_MAX_US 40000 // longest
+#define POLL_TRACK_LOCK 8       // polls on time before predictions are made
+
+// all zero to start with
+typedef struct {
+  uint32_t lastUs;   // start of the last poll
+  uint32_t periodQ4; // in 1/16 us, 0 = unknown
+  uint8_t hits;      // polls on time in a row
+  bool started;      // lastUs is set
+} PollTrack;
+
+// A poll started at us.
+void pollTrackAdd(PollTrack *t, uint32_t us);
+
+// Predicted start of the first poll after nowUs. False until locked, and once
+// the console has not polled for a few periods.
+bool pollTrackNext(const PollTrack *t, uint32_t nowUs, uint32_t *nextUs);
+
+#endif // POLLTRACK_H
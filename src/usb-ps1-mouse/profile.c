@@ -0,0 +1,248 @@
+#include "profile.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#define RECORD_MAGIC 0x4650 // "PF"
+#define RECORD_PROFILE 1
+#define RECORD_ACTIVE 2
+#define RECORD_DEVICE 3
+
+#define ACTIVE_KEY PROFILES // where[] and dirty bit of the active index
+#define DEVICE_KEY (PROFILES + 1)
+#define RECORD_KEYS (PROFILES + 2)
+
+typedef struct {
+  uint16_t magic;
+  uint8_t type;
+  uint8_t index;
+  uint32_t seq;
+  uint32_t sum; // FNV-1a of the other bytes
+  union {
+    Profile profile;    // RECORD_PROFILE
+    DeviceCache device; // RECORD_DEVICE
+  };
+} Record;
+
+static_assert(sizeof(Record) == PROFILE_PAGE, "profile record is one page");
+static_assert(sizeof(DeviceCache) <= sizeof(Profile), "device fits a record");
+
+static uint32_t fnv(uint32_t h, const uint8_t *p, uint32_t len) {
+  for (uint32_t i = 0; i != len; ++i) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+static uint32_t recordSum(const Record *r) {
+  const uint8_t *p = (const uint8_t *)r;
+  const uint32_t at = offsetof(Record, sum);
+  const uint32_t h = fnv(2166136261u, p, at);
+  return fnv(h, p + at + sizeof(r->sum), sizeof(*r) - at - sizeof(r->sum));
+}
+
+static int pageBlank(const uint8_t *p, uint32_t len) {
+  for (uint32_t i = 0; i != len; ++i) {
+    if (p[i] != 0xff) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static uint32_t sectorCount(const ProfileStore *st) {
+  return st->flash->size / st->flash->sectorSize;
+}
+
+uint32_t deviceDescrSum(const uint8_t *descr, uint32_t len) {
+  return fnv(2166136261u, descr, len);
+}
+
+// profile index of a record, ACTIVE_KEY for the active index, DEVICE_KEY for
+// the device, -1 if invalid
+static int recordKey(const Record *r) {
+  if (r->magic != RECORD_MAGIC || r->sum != recordSum(r)) {
+    return -1;
+  }
+  if (r->type == RECORD_PROFILE && r->index < PROFILES &&
+      r->profile.keyCount <= PROFILE_KEYS) {
+    return r->index;
+  }
+  if (r->type == RECORD_ACTIVE && r->index < PROFILES) {
+    return ACTIVE_KEY;
+  }
+  if (r->type == RECORD_DEVICE && r->device.version == DEVICE_CACHE_VERSION) {
+    return DEVICE_KEY;
+  }
+  return -1;
+}
+
+void profileLoad(ProfileStore *st, const ProfileFlash *flash) {
+  st->flash = flash;
+  st->active = 0;
+  st->hasDevice = 0;
+  st->dirty = 0;
+  st->blank = 0;
+  st->seq = 0;
+  st->head = 0;
+  for (uint32_t k = 0; k != RECORD_KEYS; ++k) {
+    st->where[k] = PROFILE_NO_RECORD;
+  }
+
+  uint32_t newest = PROFILE_NO_RECORD;
+  for (uint32_t at = 0; at != flash->size; at += PROFILE_PAGE) {
+    const Record *r = (const Record *)(flash->base + at);
+    const int key = recordKey(r);
+    if (key < 0) {
+      continue;
+    }
+    const uint32_t prev = st->where[key];
+    if (prev == PROFILE_NO_RECORD ||
+        (int32_t)(r->seq - ((const Record *)(flash->base + prev))->seq) > 0) {
+      st->where[key] = at;
+    }
+    if (newest == PROFILE_NO_RECORD || (int32_t)(r->seq - st->seq) > 0) {
+      newest = at;
+      st->seq = r->seq;
+    }
+  }
+  for (uint32_t s = 0; s != sectorCount(st); ++s) {
+    if (pageBlank(flash->base + s * flash->sectorSize, flash->sectorSize)) {
+      st->blank |= 1u << s;
+    }
+  }
+  if (newest != PROFILE_NO_RECORD) {
+    st->head = (newest + PROFILE_PAGE) % flash->size;
+  }
+
+  for (uint32_t i = 0; i != PROFILES; ++i) {
+    if (st->where[i] != PROFILE_NO_RECORD) {
+      const Record *r = (const Record *)(flash->base + st->where[i]);
+      st->profiles[i] = r->profile;
+    }
+  }
+  if (st->where[ACTIVE_KEY] != PROFILE_NO_RECORD) {
+    const Record *r = (const Record *)(flash->base + st->where[ACTIVE_KEY]);
+    st->active = r->index;
+  }
+  if (st->where[DEVICE_KEY] != PROFILE_NO_RECORD) {
+    const Record *r = (const Record *)(flash->base + st->where[DEVICE_KEY]);
+    st->device = r->device;
+    st->hasDevice = 1;
+  }
+}
+
+void profileSave(ProfileStore *st, uint8_t i) {
+  if (i < PROFILES) {
+    st->dirty |= 1 << i;
+  }
+}
+
+void profileSelect(ProfileStore *st, uint8_t i) {
+  if (i < PROFILES) {
+    st->active = i;
+    st->dirty |= 1 << ACTIVE_KEY;
+  }
+}
+
+void profileSaveDevice(ProfileStore *st, const DeviceCache *d) {
+  if (st->hasDevice && memcmp(&st->device, d, sizeof(*d)) == 0) {
+    return;
+  }
+  st->device = *d;
+  st->hasDevice = 1;
+  st->dirty |= 1 << DEVICE_KEY;
+}
+
+// mark the records living in sector s to be written again elsewhere
+static uint32_t relocate(ProfileStore *st, uint32_t s) {
+  uint32_t keys = 0;
+  for (uint32_t k = 0; k != RECORD_KEYS; ++k) {
+    if (st->where[k] != PROFILE_NO_RECORD &&
+        st->where[k] / st->flash->sectorSize == s) {
+      keys |= 1u << k;
+    }
+  }
+  st->dirty |= keys;
+  return keys;
+}
+
+static void eraseSector(ProfileStore *st, uint32_t s) {
+  relocate(st, s); // normally done already, RAM has the contents anyway
+  for (uint32_t k = 0; k != RECORD_KEYS; ++k) {
+    if (st->where[k] != PROFILE_NO_RECORD &&
+        st->where[k] / st->flash->sectorSize == s) {
+      st->where[k] = PROFILE_NO_RECORD;
+    }
+  }
+  st->flash->erase(s * st->flash->sectorSize);
+  st->blank |= 1u << s;
+}
+
+int profileFlush(ProfileStore *st, int canErase) {
+  const ProfileFlash *flash = st->flash;
+  const uint32_t sector = st->head / flash->sectorSize;
+  const uint32_t next = (sector + 1) % sectorCount(st);
+
+  // the log has come round to a used sector
+  if (st->head % flash->sectorSize == 0 && !(st->blank & (1u << sector))) {
+    if (!canErase) {
+      return st->dirty != 0;
+    }
+    eraseSector(st, sector);
+    return st->dirty != 0;
+  }
+
+  // Records still in the next sector are written again first, so it holds
+  // nothing of value by the time this one is full.
+  const uint32_t moving = relocate(st, next);
+  if (!st->dirty) {
+    // erase ahead while nothing else is going on
+    if (canErase && !(st->blank & (1u << next))) {
+      eraseSector(st, next);
+    }
+    return 0;
+  }
+
+  const uint8_t *page = flash->base + st->head;
+  if (!pageBlank(page, PROFILE_PAGE)) {
+    // torn write from before a reset, or a record we lost track of
+    st->head = (st->head + PROFILE_PAGE) % flash->size;
+    return 1;
+  }
+
+  const uint32_t pick = moving ? moving : st->dirty;
+  uint32_t key = 0;
+  while (!(pick & (1u << key))) {
+    ++key;
+  }
+  Record r;
+  memset(&r, 0, sizeof(r));
+  r.magic = RECORD_MAGIC;
+  r.seq = st->seq + 1;
+  if (key == ACTIVE_KEY) {
+    r.type = RECORD_ACTIVE;
+    r.index = st->active;
+  } else if (key == DEVICE_KEY) {
+    r.type = RECORD_DEVICE;
+    r.device = st->device;
+  } else {
+    r.type = RECORD_PROFILE;
+    r.index = key;
+    r.profile = st->profiles[key];
+  }
+  r.sum = recordSum(&r);
+  flash->program(st->head, (const uint8_t *)&r);
+
+  st->blank &= ~(1u << sector);
+  st->seq = r.seq;
+  st->dirty &= ~(1u << key);
+  if (recordKey((const Record *)page) == (int)key) {
+    st->where[key] = st->head;
+  } else {
+    st->dirty |= 1u << key; // did not verify, try the next page
+  }
+  st->head = (st->head + PROFILE_PAGE) % flash->size;
+  return st->dirty != 0;
+}
@@ -0,0 +1,103 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#include "motion.h"
+#include "parsemouse.h"
+
+// Button mapping profiles. The store is a log of one-page records spread over
+// a few flash sectors: saving a profile programs the next free page, and a
+// sector is only erased once the log comes round to it again. Flash access
+// goes through ProfileFlash so the store also runs on a simulated flash. The
+// last device mounted is kept in the same log, see DeviceCache.
+
+#define PROFILES 4
+#define PROFILE_KEYS 58 // key bindings per profile
+
+#define PROFILE_SPEED_1X 8 // mouseSpeed of unscaled motion
+
+// flags
+#define PROFILE_SWAP_BUTTONS 0x01
+#define PROFILE_ANALOG 0x02 // mouse and keyboard are one analog pad
+
+// keyboard usages reserved by HID, bound here to the mouse buttons
+#define PROFILE_KEY_MOUSE_LEFT 0xF0
+#define PROFILE_KEY_MOUSE_RIGHT 0xF1
+
+typedef struct {
+  uint8_t key; // keyboard usage, modifiers are 0xE0-0xE7
+  uint8_t reserved;
+  uint16_t buttons; // pad buttons as in KEY_BUTTON_MAP
+} KeyBinding;
+
+typedef struct {
+  uint8_t mouseSpeed; // motion scale in 1/8
+  uint8_t flags;
+  uint8_t keyCount; // entries used in keys[]
+  uint8_t reserved;
+  KeyBinding keys[PROFILE_KEYS];
+  MotionConf motion; // zero in records from before it, like the keys were
+} Profile;
+
+// The last device mounted: the adapter answers as its controller type right
+// from power-up, and a mouse that comes back with the same report descriptor
+// gets its compiled plan instead of being parsed again.
+#define DEVICE_CACHE_VERSION 1 // plans of other firmware are not used
+
+typedef struct {
+  uint8_t version;
+  uint8_t protocol; // 1 keyboard, 2 mouse
+  uint16_t vid;
+  uint16_t pid;
+  uint16_t descrLen;
+  uint32_t descrSum; // deviceDescrSum() of the report descriptor
+  MousePlan mouse;   // protocol 2
+} DeviceCache;
+
+#define PROFILE_PAGE 256 // record size, one flash page
+
+typedef struct {
+  const uint8_t *base; // store contents, read in place
+  uint32_t size;       // whole sectors
+  uint32_t sectorSize;
+  void (*erase)(uint32_t offset);                        // one sector
+  void (*program)(uint32_t offset, const uint8_t *page); // one page
+} ProfileFlash;
+
+#define PROFILE_NO_RECORD 0xffffffff
+
+typedef struct {
+  const ProfileFlash *flash;
+  Profile profiles[PROFILES];
+  uint8_t active;
+  uint8_t dirty;   // records to write: bit per profile, active index, device
+  uint32_t blank;  // bit per erased sector
+  uint32_t seq;    // of the newest record
+  uint32_t head;   // offset of the next page to program
+  uint32_t where[PROFILES + 2]; // newest record of each profile, active index
+                                // and device
+  uint8_t hasDevice;            // device is set
+  DeviceCache device;
+} ProfileStore;
+
+// Reads the newest record of every profile, the active index and the device.
+// Profiles without a record keep what the caller put in st->profiles.
+void profileLoad(ProfileStore *st, const ProfileFlash *flash);
+
+// Marks profile i to be written; profileSelect() also marks the active index.
+void profileSave(ProfileStore *st, uint8_t i);
+void profileSelect(ProfileStore *st, uint8_t i);
+
+// Makes d the cached device, to be written unless the store has it already.
+// Padding in d must be zeroed.
+void profileSaveDevice(ProfileStore *st, const DeviceCache *d);
+
+// FNV-1a of a report descriptor, to tell whether the cached plan fits
+uint32_t deviceDescrSum(const uint8_t *descr, uint32_t len);
+
+// Writes at most one record, or erases a sector if canErase. Returns non-zero
+// while records are waiting.
+int profileFlush(ProfileStore *st, int canErase);
+
+#endif // PROFILE_H
@@ -0,0 +1,97 @@
+#include "siotiming.h"
+
+#include "sram.h"
+
+// bounds for a plausible CLK period, the PS1 runs at 250 kHz
+#define PERIOD_MIN_NS 1000
+#define PERIOD_MAX_NS 20000
+
+// least delay and width whatever the clock, as on a DualShock
+#define DELAY_MIN_US 6
+#define WIDTH_MIN_US 2
+
+void sioTimingInit(SioTiming *t) {
+  t->delay = SIO_DELAY_SAFE;
+  t->width = SIO_WIDTH_SAFE;
+  t->state = SIO_CAL_MEASURING;
+  t->samples = 0;
+  t->cut = 0;
+  t->periodNs = 0;
+  t->periodMinNs = UINT32_MAX;
+  t->periodMaxNs = 0;
+  t->periodSumNs = 0;
+  t->gapUs = INT32_MAX;
+}
+
+static uint32_t SRAM_FUNC(clampUs)(uint32_t us, uint32_t lo, uint32_t hi) {
+  return us < lo ? lo : us > hi ? hi : us;
+}
+
+static bool SRAM_FUNC(sioTimingSet)(SioTiming *t, uint8_t delay,
+                                    uint8_t width) {
+  const bool changed = delay != t->delay || width != t->width;
+  t->delay = delay;
+  t->width = width;
+  return changed;
+}
+
+bool SRAM_FUNC(sioTimingSample)(SioTiming *t, uint32_t edges, uint32_t spanUs,
+                                uint32_t intervalUs) {
+  if (t->state != SIO_CAL_MEASURING || edges < 4) {
+    return false;
+  }
+  const uint32_t period = spanUs * 1000 / (edges - 1);
+  if (period < PERIOD_MIN_NS || period > PERIOD_MAX_NS) {
+    return false;
+  }
+  if (period < t->periodMinNs) {
+    t->periodMinNs = period;
+  }
+  if (period > t->periodMaxNs) {
+    t->periodMaxNs = period;
+  }
+  t->periodSumNs += period;
+  // what the console left between our ACK and byte 1
+  const int32_t gap = (int32_t)intervalUs - (int32_t)(8 * period / 1000) -
+                      (t->delay + 1) - (t->width + 1);
+  if (gap < t->gapUs) {
+    t->gapUs = gap;
+  }
+  if (++t->samples != SIO_CAL_SAMPLES) {
+    return false;
+  }
+
+  t->periodNs = t->periodSumNs / SIO_CAL_SAMPLES;
+  if (t->periodMaxNs - t->periodMinNs > t->periodNs / 4) {
+    t->state = SIO_CAL_SAFE; // clock or measurement too unsteady
+    return false;
+  }
+  t->state = SIO_CAL_ADAPTED;
+  const uint32_t delayUs = clampUs((2 * t->periodNs + 999) / 1000,
+                                   DELAY_MIN_US, SIO_DELAY_SAFE + 1);
+  uint32_t widthUs = clampUs((t->periodNs / 2 + 999) / 1000, WIDTH_MIN_US,
+                             SIO_WIDTH_SAFE + 1);
+  if (t->gapUs < 0) {
+    // the console clocked byte 1 while we still held ACK
+    const int32_t fit = SIO_WIDTH_SAFE + t->gapUs;
+    if (fit < (int32_t)widthUs) {
+      widthUs = fit < WIDTH_MIN_US ? WIDTH_MIN_US : (uint32_t)fit;
+    }
+  }
+  return sioTimingSet(t, delayUs - 1, widthUs - 1);
+}
+
+bool SRAM_FUNC(sioTimingResult)(SioTiming *t, bool complete) {
+  if (t->state != SIO_CAL_ADAPTED) {
+    return false;
+  }
+  if (complete) {
+    t->cut = 0;
+    return false;
+  }
+  if (++t->cut != SIO_CAL_CUT) {
+    return false;
+  }
+  t->state = SIO_CAL_SAFE;
+  return sioTimingSet(t, SIO_DELAY_SAFE, SIO_WIDTH_SAFE);
+}
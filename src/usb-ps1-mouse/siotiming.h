@@ -0,0 +1,78 @@
+#ifndef SIOTIMING_H
+#define SIOTIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ACK timing of psx_sio, adapted to the console. The first transactions are
+// measured: the CLK period during byte 0, and how long the console takes from
+// our ACK to the next byte. Delay and width then shrink from the safe values
+// to what the measured clock needs. If the measurements disagree, or the
+// console cuts replies short afterwards, the safe values stay for good.
+//
+// Delay and width are psx_sio loop counts: n stands for n + 1 us.
+
+#define SIO_DELAY_SAFE 14 // 15 us from the end of a byte to ACK
+#define SIO_WIDTH_SAFE 3  // 4 us ACK pulse
+#define SIO_LOOP_MAX 31
+
+#define SIO_CAL_SAMPLES 8 // transactions measured
+#define SIO_CAL_CUT 3     // replies cut short in a row before falling back
+
+#define SIO_CAL_MEASURING 0
+#define SIO_CAL_ADAPTED 1
+#define SIO_CAL_SAFE 2 // measurements unusable or fallen back
+
+typedef struct {
+  uint8_t delay;
+  uint8_t width;
+  uint8_t state;
+  uint8_t samples;
+  uint8_t cut;          // replies cut short in a row since adapting
+  uint32_t periodNs;    // CLK period, mean of the samples
+  uint32_t periodMinNs; // of the samples
+  uint32_t periodMaxNs;
+  uint32_t periodSumNs;
+  int32_t gapUs; // ACK release to the next byte, least seen
+} SioTiming;
+
+// TX words of psx_sio.pio. The first of a transaction is the inverted
+// response for byte 0 in bits 0..7 and the ACK delay after it in bits 8..12.
+// Each following one is the verdict on the byte just received: bit 0 =
+// acknowledge and go on, bits 1..5 = ACK width, bits 6..13 = inverted response
+// for the next byte, bits 14..18 = ACK delay after it. test/psx_sio.txt holds
+// them against the program itself.
+static inline uint32_t sioFirstWord(uint8_t response, uint8_t delay) {
+  return (uint8_t)~response | (uint32_t)delay << 8;
+}
+
+// ACK width and delay of a verdict, worked out once per timing change
+static inline uint32_t sioVerdictTiming(uint8_t width, uint8_t delay) {
+  return (uint32_t)width << 1 | (uint32_t)delay << 14;
+}
+
+static inline uint32_t sioVerdict(bool ack, uint8_t next, uint32_t timing) {
+  return (uint32_t)ack | timing | (uint32_t)(uint8_t)~next << 6;
+}
+
+// the fields back, as psx_sio reads them
+static inline uint8_t sioFirstResponse(uint32_t w) { return ~w; }
+static inline uint8_t sioFirstDelay(uint32_t w) { return w >> 8 & 31; }
+static inline bool sioVerdictAck(uint32_t w) { return w & 1; }
+static inline uint8_t sioVerdictWidth(uint32_t w) { return w >> 1 & 31; }
+static inline uint8_t sioVerdictNext(uint32_t w) { return ~(w >> 6); }
+static inline uint8_t sioVerdictDelay(uint32_t w) { return w >> 14 & 31; }
+
+void sioTimingInit(SioTiming *t);
+
+// One measured transaction: `edges` falling CLK edges of byte 0, spanUs from
+// the first to the last, and intervalUs from byte 0 to byte 1 arriving.
+// Returns true when delay or width changed.
+bool sioTimingSample(SioTiming *t, uint32_t edges, uint32_t spanUs,
+                     uint32_t intervalUs);
+
+// A transaction after adapting: did the reply go out completely? Returns true
+// when delay or width changed.
+bool sioTimingResult(SioTiming *t, bool complete);
+
+#endif // SIOTIMING_H
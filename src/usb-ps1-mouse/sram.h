@@ -0,0 +1,27 @@
+#ifndef SRAM_H
+#define SRAM_H
+
+// Placement of the timing-critical code and tables. Everything core0 runs for
+// the SIO, and the path of a USB report on core1, is copied to SRAM at boot,
+// so a miss of the XIP cache both cores share cannot stall them for a flash
+// read. Cold code and tables stay in flash. tools/memreport.sh lists what
+// ended up where.
+//
+// Whether this shortens the loop times on the RP2040 has not been measured.
+// 0 leaves all of it in flash, to compare the core0 loop times latencyPrint()
+// reports with DEBUG_STDOUT; keep 1 only if that comparison favours it.
+#define SRAM_HOT 1
+
+#if SRAM_HOT && PICO_ON_DEVICE
+#include "pico.h"
+#define SRAM_FUNC(f) __not_in_flash_func(f) // section .time_critical.f
+// for callers in flash, which would otherwise get an inlined copy
+#define SRAM_NOINLINE(f) __no_inline_not_in_flash_func(f)
+#define SRAM_TABLE(name) __not_in_flash(name)
+#else
+#define SRAM_FUNC(f) f
+#define SRAM_NOINLINE(f) f
+#define SRAM_TABLE(name)
+#endif
+
+#endif // SRAM_H
@@ -0,0 +1,153 @@
+#include "trace.h"
+
+#include <string.h>
+
+#include "hardware/structs/timer.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+#include "pico/stdlib.h"
+#include "sram.h"
+
+static_assert(sizeof(TraceRecord) == 32, "trace record layout");
+
+// single producer (one core), single consumer (core1)
+typedef struct {
+  volatile uint32_t head; // producer
+  volatile uint32_t tail; // consumer
+  volatile uint32_t lost; // producer, events dropped
+  uint32_t lostSent;      // consumer
+  TraceRecord rec[TRACE_RECORDS];
+} TraceRing;
+
+static TraceRing gTraceRings[2]; // indexed by core
+static TraceRing *gTraceCont = NULL; // ring with an event half sent
+
+void traceInit() { uart_set_baudrate(uart_default, TRACE_BAUD); }
+
+// time_us_64() from the timer registers; the SDK's is in flash
+static inline uint64_t SRAM_FUNC(traceNowUs)() {
+  uint32_t hi = timer_hw->timerawh;
+  uint32_t lo;
+  while (true) {
+    lo = timer_hw->timerawl;
+    const uint32_t next = timer_hw->timerawh;
+    if (next == hi) {
+      break;
+    }
+    hi = next;
+  }
+  return (uint64_t)hi << 32 | lo;
+}
+
+void SRAM_FUNC(traceEvent)(uint8_t type, uint8_t addr, uint8_t instance,
+                           uint8_t param, uint8_t flags, uint16_t arg0,
+                           uint16_t arg1, const uint8_t *data, uint16_t len) {
+  TraceRing *ring = gTraceRings + get_core_num();
+  const uint32_t head = ring->head;
+  uint32_t n = 1;
+  if (len > TRACE_EV_DATA) {
+    n += (len - TRACE_EV_DATA + TRACE_MORE_DATA - 1) / TRACE_MORE_DATA;
+  }
+  if (TRACE_RECORDS - (head - ring->tail) < n) {
+    ring->lost = ring->lost + 1;
+    return;
+  }
+
+  TraceRecord *r = ring->rec + head % TRACE_RECORDS;
+  uint16_t size = len < TRACE_EV_DATA ? len : TRACE_EV_DATA;
+  r->type = type;
+  r->size = size;
+  r->ev.addr = addr;
+  r->ev.instance = instance;
+  r->ev.param = param;
+  r->ev.flags = flags;
+  const uint64_t us = traceNowUs();
+  r->ev.usLo = (uint32_t)us;
+  r->ev.usHi = (uint32_t)(us >> 32);
+  r->ev.len = len;
+  r->ev.arg[0] = arg0;
+  r->ev.arg[1] = arg1;
+  if (size) {
+    memcpy(r->ev.data, data, size);
+  }
+  for (uint32_t i = 1; i != n; ++i) {
+    data += size;
+    len -= size;
+    size = len < TRACE_MORE_DATA ? len : TRACE_MORE_DATA;
+    r = ring->rec + (head + i) % TRACE_RECORDS;
+    r->type = TRACE_MORE;
+    r->size = size;
+    memcpy(r->more, data, size);
+  }
+  __dmb();
+  ring->head = head + n;
+}
+
+// oldest pending event of both rings, or the rest of a half sent one
+static TraceRing *traceSource() {
+  if (gTraceCont) {
+    return gTraceCont;
+  }
+  TraceRing *best = NULL;
+  for (int i = 0; i != 2; ++i) {
+    TraceRing *ring = gTraceRings + i;
+    if (ring->tail == ring->head) {
+      continue;
+    }
+    // the low word is enough to order events queued at the same time
+    if (!best || (int32_t)(ring->rec[ring->tail % TRACE_RECORDS].ev.usLo -
+                           best->rec[best->tail % TRACE_RECORDS].ev.usLo) < 0) {
+      best = ring;
+    }
+  }
+  return best;
+}
+
+void traceDrainTask() {
+  // a whole record fits the empty TX FIFO, so this never waits
+  if (!(uart_get_hw(uart_default)->fr & UART_UARTFR_TXFE_BITS)) {
+    return;
+  }
+
+  TraceRecord r;
+  TraceRing *ring = NULL;
+  for (int i = 0; i != 2 && !gTraceCont; ++i) {
+    const uint32_t lost = gTraceRings[i].lost;
+    if (lost != gTraceRings[i].lostSent) {
+      memset(&r, 0, sizeof(r));
+      r.type = TRACE_LOST;
+      r.ev.param = i;
+      const uint64_t us = traceNowUs();
+      r.ev.usLo = (uint32_t)us;
+      r.ev.usHi = (uint32_t)(us >> 32);
+      r.ev.arg[0] = MIN(lost - gTraceRings[i].lostSent, 0xffff);
+      gTraceRings[i].lostSent += r.ev.arg[0];
+      ring = gTraceRings + i;
+      break;
+    }
+  }
+  if (!ring) {
+    if (!(ring = traceSource())) {
+      return;
+    }
+    __dmb();
+    r = ring->rec[ring->tail % TRACE_RECORDS];
+    __dmb();
+    const uint32_t tail = ring->tail + 1;
+    ring->tail = tail;
+    gTraceCont =
+        tail != ring->head && ring->rec[tail % TRACE_RECORDS].type == TRACE_MORE
+            ? ring
+            : NULL;
+  }
+
+  r.magic = TRACE_MAGIC;
+  r.sum = 0;
+  uint8_t sum = 0;
+  const uint8_t *p = (const uint8_t *)&r;
+  for (uint32_t i = 0; i != sizeof(r); ++i) {
+    sum += p[i];
+  }
+  r.sum = -sum;
+  uart_write_blocking(uart_default, p, sizeof(r));
+}
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Binary event trace: both cores write fixed-size records into their own
+// lock-free ring, core1 sends them to the stdio UART while the USB task is
+// idle. Text written with printf stays readable in between. Convert the
+// output back to JSON lines with tools/psxtrace.c.
+//
+// Record format, 32 bytes little endian:
+//   uint8_t magic;  TRACE_MAGIC
+//   uint8_t sum;    all 32 bytes add up to 0 (mod 256)
+//   uint8_t type;   TRACE_*
+//   uint8_t size;   payload bytes in this record
+// TRACE_MORE records continue the payload of the previous event:
+//   uint8_t data[28];
+// all other records start an event:
+//   uint8_t addr, instance, param, flags;
+//   uint32_t usLo, usHi; time since boot
+//   uint16_t len;   payload bytes of the whole event
+//   uint16_t arg[2];
+//   uint8_t data[10];
+
+#define TRACE_MAGIC 0xa5
+#define TRACE_BAUD 921600 // stdio UART speed while tracing
+#define TRACE_RECORDS 64  // per core, power of 2
+#define TRACE_EV_DATA 10
+#define TRACE_MORE_DATA 28
+
+#define TRACE_MORE 0
+#define TRACE_MOUNT 1      // param protocol, arg vid/pid, payload descriptor
+#define TRACE_UMOUNT 2
+#define TRACE_REPORT 3     // payload report
+#define TRACE_PARSE_FAIL 4 // param protocol, flags TRACE_F_DESCR
+#define TRACE_POLL 5       // payload reply to a 0x42 poll
+#define TRACE_POLL_IGNORED 6 // param received byte, arg[0] its index
+#define TRACE_LOST 7         // param core, arg[0] events dropped
+
+#define TRACE_F_NO_REQUEST 1 // tuh_hid_receive_report() failed
+#define TRACE_F_DESCR 2      // the report descriptor did not parse
+
+typedef struct {
+  uint8_t magic;
+  uint8_t sum;
+  uint8_t type;
+  uint8_t size;
+  union {
+    struct {
+      uint8_t addr;
+      uint8_t instance;
+      uint8_t param;
+      uint8_t flags;
+      uint32_t usLo; // time since boot
+      uint32_t usHi;
+      uint16_t len;
+      uint16_t arg[2];
+      uint8_t data[TRACE_EV_DATA];
+    } ev;
+    uint8_t more[TRACE_MORE_DATA];
+  };
+} TraceRecord;
+
+void traceInit(); // after stdio_init_all()
+
+// Either core, never blocks. Drops the whole event when the ring is full.
+void traceEvent(uint8_t type, uint8_t addr, uint8_t instance, uint8_t param,
+                uint8_t flags, uint16_t arg0, uint16_t arg1,
+                const uint8_t *data, uint16_t len);
+
+void traceDrainTask(); // core1, sends at most one record per call
+
+#endif // TRACE_H
@@ -64,14 +64,16 @@ extern "C" {
 // HOST CONFIGURATION
 //--------------------------------------------------------------------
 
-// Size of buffer to hold descriptors and other data used for enumeration
-#define CFG_TUH_ENUMERATION_BUFSIZE 256
+// Size of buffer to hold descriptors and other data used for enumeration.
+// Report descriptors that do not fit arrive empty; gaming mice with vendor
+// collections get past 256 bytes.
+#define CFG_TUH_ENUMERATION_BUFSIZE 1024
 
 #define CFG_TUH_HUB 1
 // max device support (excluding hub device)
-#define CFG_TUH_DEVICE_MAX (CFG_TUH_HUB ? 4 : 1) // hub typically has 4 ports
+#define CFG_TUH_DEVICE_MAX (CFG_TUH_HUB ? 7 : 1) // up to a 7-port hub
 
-#define CFG_TUH_HID 4
+#define CFG_TUH_HID 16 // interfaces, also the adapter's device table
 #define CFG_TUH_HID_EPIN_BUFSIZE 64
 #define CFG_TUH_HID_EPOUT_BUFSIZE 64
 
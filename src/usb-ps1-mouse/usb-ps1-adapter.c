@@ -1,13 +1,30 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "capture.h"
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
 #include "hardware/pio.h"
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
+#include "latency.h"
+#include "motion.h"
+#include "padcmd.h"
+#include "parsekeyb.h"
 #include "parsemouse.h"
 #include "pico/bootrom.h"
+#include "pico/flash.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
+#include "polltrack.h"
+#include "profile.h"
+#include "psx_sio.pio.h"
+#include "siotiming.h"
+#include "sram.h"
+#include "trace.h"
 #include "ws2812.pio.h"
 
 #define PIO_USB_DP_PIN_DEFAULT 2 // must be before usb headers
@@ -20,6 +37,8 @@
 //--------------------------------------------------------------------+
 
 #define DEBUG_STDOUT 0
+#define PSX_CAPTURE 0 // log PS1 bus edges to stdio, see capture.h
+#define DEBUG_TRACE 0 // binary USB/PS1 event trace on stdio, see trace.h
 
 #define IS_RGBW false
 #define WS2812_PIN 16
@@ -30,6 +49,25 @@
 #define GP_CMD 14
 #define GP_ACK 15
 
+static_assert(GP_ATT == psx_sio_ATT_PIN, "psx_sio.pio waits on ATT by number");
+static_assert(GP_CLK == psx_sio_CLK_PIN, "psx_sio.pio waits on CLK by number");
+
+// Motion not yet sent to the console is carried over to the next polls, up to
+// this many counts per axis; anything beyond is dropped.
+#define MOTION_BACKLOG_MAX 1024
+
+// Analog mode: stick deflection at which games start to react. The right
+// stick is the mouse motion of one poll added on top of it.
+#define ANALOG_DEADZONE 20
+
+// 1: mice are asked for a report just ahead of the console's next poll instead
+// of all the time, so each poll gets the motion up to the last moment; see
+// pollAlignTask(). Keyboards report as they like, short taps must not wait.
+// Off by default: a 1000 Hz mouse then sends about one report per frame, and
+// a boot or 8-bit mouse clips its motion at 127 per report while it waits.
+#define POLL_ALIGN 0
+#define ALIGN_MARGIN_US 500 // for core1 to take the report and build a frame
+
 #define PIX_OFF 0
 #define PIX_BLINK 1
 #define PIX_MOUSE 2
@@ -37,6 +75,15 @@
 #define PIX_CLICK 4
 #define PIX_OVF 5
 
+// pad buttons, as in KEY_BUTTON_MAP
+#define PAD_UP 0x0010
+#define PAD_RIGHT 0x0020
+#define PAD_DOWN 0x0040
+#define PAD_LEFT 0x0080
+#define PAD_DIRS (PAD_UP | PAD_RIGHT | PAD_DOWN | PAD_LEFT)
+#define PAD_L1 0x0400
+#define PAD_R1 0x0800
+
 #define COLOR_BLACK 0x000000
 #define COLOR_FAINT_MOUSE_GREEN 0x020001
 #define COLOR_FAINT_KEYBOARD_VIOLET 0x000202
@@ -82,22 +129,24 @@ static const uint16_t *MOD_PTR = KEY_BUTTON_MAP + 4;
 
 /*------------- MAIN -------------*/
 
-auto_init_mutex(mtx);
-uint8_t gPixState = PIX_BLINK;
+uint8_t gPixState = PIX_BLINK; // core1 only
 
-// core1: handle host events
-void core1_main() {
-  sleep_ms(10);
+void framePublish();
+void frameRefresh();
+void profilesInit();
+void profilesLoad();
+void deviceExpect();
+void pollAlignTask();
+void bootTask();
+void profileTask();
+void latencyPrint();
 
-  // Use tuh_configure() to pass pio configuration to the host stack
-  tuh_hid_set_default_protocol(HID_PROTOCOL_REPORT);
-  pio_usb_configuration_t pio_cfg = PIO_USB_DEFAULT_CONFIG;
-  tuh_configure(1, TUH_CFGID_RPI_PIO_USB_CONFIGURATION, &pio_cfg);
-
-  // To run USB SOF interrupt in core1, init host stack for pio_usb (roothub
-  // port1) on core1
-  tuh_init(1);
+// The status LED is fed by DMA: a word per update, never waiting on the
+// ws2812 state machine.
+static int gLedDma;
+static uint32_t gLedWord; // GRB << 8, read by the DMA channel
 
+void ledInit() {
   PIO pio;
   uint sm;
   uint offset;
@@ -112,221 +161,890 @@ void core1_main() {
 
   ws2812_program_init(pio, sm, offset, WS2812_PIN, 800000, IS_RGBW);
 
-  uint64_t prevTime = to_us_since_boot(get_absolute_time());
+  gLedDma = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(gLedDma);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+  dma_channel_configure(gLedDma, &c, &pio->txf[sm], &gLedWord, 1, false);
+}
+
+// core1, every 50 ms: the colour of gPixState, blinking at 1 Hz
+void ledTask() {
+  static uint8_t blinkI = 0;
+  uint32_t pixGRB;
+  switch (gPixState) {
+  case PIX_OFF:
+    pixGRB = COLOR_BLACK;
+    break;
+  case PIX_BLINK:
+    if (blinkI < 10) {
+      pixGRB = COLOR_FAINT_WARM_WHITE;
+    } else {
+      pixGRB = COLOR_BLACK;
+    }
+    break;
+  case PIX_MOUSE:
+    pixGRB = COLOR_FAINT_MOUSE_GREEN;
+    break;
+  case PIX_KEYB:
+    pixGRB = COLOR_FAINT_KEYBOARD_VIOLET;
+    break;
+  case PIX_OVF:
+    pixGRB = COLOR_FAINT_RED;
+    break;
+  case PIX_CLICK:
+    pixGRB = COLOR_FAINT_WARM_WHITE;
+    break;
+  default:
+    gPixState = PIX_OFF;
+    pixGRB = COLOR_BLACK;
+    break;
+  }
+  ++blinkI;
+  if (blinkI == 20) {
+    blinkI = 0;
+  }
+  // one word takes 30 us to go out, long done by the next update
+  if (!dma_channel_is_busy(gLedDma)) {
+    gLedWord = pixGRB << 8u;
+    dma_channel_set_read_addr(gLedDma, &gLedWord, true);
+  }
+}
+
+static Hist gUsbGap = {.shift = 4}; // core1: from one tuh_task() to the next
+static uint32_t gUsbLastUs;
 
-  uint64_t timeSum = 0;
+static void usbTask() {
+  const uint32_t now = time_us_32();
+  if (gUsbLastUs) {
+    histAdd(&gUsbGap, now - gUsbLastUs);
+  }
+  gUsbLastUs = now;
+  tuh_task(); // tinyusb host task
+}
 
-  const uint64_t updatePeriod = 50 * 1000; // 50k us = 20 upd/s
+#if DEBUG_TRACE
+static void traceTask() {
+  if (!tuh_task_event_ready()) {
+    traceDrainTask();
+  }
+}
+#endif
 
-  uint8_t blinkI = 0;
+// Cooperative scheduler of core1. Every pass runs the jobs without a period,
+// USB first, then at most one job that is due, so tuh_task() never waits for
+// more than the longest job. Run times are counted per job.
+typedef struct {
+  const char *name;
+  void (*run)();
+  uint32_t periodUs; // 0 = every pass
+  uint32_t dueUs;
+  uint32_t runs;
+  uint32_t maxUs;  // longest run
+  uint64_t busyUs; // all runs
+} Core1Task;
+
+static Core1Task gTasks[] = {
+    {.name = "usb", .run = usbTask},
+    {.name = "frame", .run = frameRefresh},
+    {.name = "align", .run = pollAlignTask},
+    {.name = "boot", .run = bootTask},
+#if DEBUG_TRACE
+    {.name = "trace", .run = traceTask},
+#endif
+#if PSX_CAPTURE
+    {.name = "capture", .run = captureDumpTask},
+#endif
+    {.name = "profile", .run = profileTask, .periodUs = 1000},
+    {.name = "led", .run = ledTask, .periodUs = 50000},
+#if DEBUG_STDOUT
+    {.name = "stats", .run = latencyPrint, .periodUs = 5000000},
+#endif
+};
 
-  uint32_t pixGRB = 0;
+#define TASKS (sizeof(gTasks) / sizeof(gTasks[0]))
 
-  while (true) {
-    tuh_task(); // tinyusb host task
-
-    uint64_t currTime = to_us_since_boot(get_absolute_time());
-    timeSum += (currTime - prevTime);
-    prevTime = currTime;
-
-    if (timeSum >= updatePeriod) {
-      timeSum -= updatePeriod;
-      mutex_enter_blocking(&mtx);
-      const uint8_t pixStateTmp = gPixState;
-      mutex_exit(&mtx);
-      switch (pixStateTmp) {
-      case PIX_OFF:
-        pixGRB = COLOR_BLACK;
-        break;
-      case PIX_BLINK:
-        if (blinkI < 10) {
-          pixGRB = COLOR_FAINT_WARM_WHITE;
-        } else {
-          pixGRB = COLOR_BLACK;
-        }
-        break;
-      case PIX_MOUSE:
-        pixGRB = COLOR_FAINT_MOUSE_GREEN;
-        break;
-      case PIX_KEYB:
-        pixGRB = COLOR_FAINT_KEYBOARD_VIOLET;
-        break;
-      case PIX_OVF:
-        pixGRB = COLOR_FAINT_RED;
-        break;
-      case PIX_CLICK:
-        pixGRB = COLOR_FAINT_WARM_WHITE;
-        break;
-      default:
-        mutex_enter_blocking(&mtx);
-        gPixState = PIX_OFF;
-        mutex_exit(&mtx);
-        pixGRB = COLOR_BLACK;
-        break;
+static inline uint32_t taskRun(Core1Task *t, uint32_t start) {
+  t->run();
+  const uint32_t end = time_us_32();
+  const uint32_t us = end - start;
+  ++t->runs;
+  t->busyUs += us;
+  if (us > t->maxUs) {
+    t->maxUs = us;
+  }
+  return end;
+}
+
+// core1: one pass of the main loop
+void core1Pass() {
+  uint32_t now = time_us_32();
+  uint32_t i = 0;
+  for (; i != TASKS && gTasks[i].periodUs == 0; ++i) {
+    now = taskRun(gTasks + i, now);
+  }
+  for (; i != TASKS; ++i) {
+    Core1Task *t = gTasks + i;
+    if ((int32_t)(now - t->dueUs) >= 0) {
+      // a job that fell behind starts its period afresh
+      t->dueUs += t->periodUs;
+      if ((int32_t)(now - t->dueUs) >= 0) {
+        t->dueUs = now + t->periodUs;
       }
-      ++blinkI;
-      if (blinkI == 20) {
-        blinkI = 0;
+      taskRun(t, now);
+      return;
+    }
+  }
+}
+
+// core1: handle host events
+void core1_main() {
+  // Core0 answers the console before anything slow: a first reply from the
+  // built-in profiles, while the store is read.
+  profilesInit();
+  framePublish();
+
+  // Use tuh_configure() to pass pio configuration to the host stack
+  pio_usb_configuration_t pio_cfg = PIO_USB_DEFAULT_CONFIG;
+  tuh_hid_set_default_protocol(HID_PROTOCOL_REPORT);
+  tuh_configure(1, TUH_CFGID_RPI_PIO_USB_CONFIGURATION, &pio_cfg);
+
+  // To run USB SOF interrupt in core1, init host stack for pio_usb (roothub
+  // port1) on core1. PIO-USB loads its programs first: psx_sio then takes a
+  // PIO with room left, as it did before the early reply.
+  tuh_init(1);
+  multicore_fifo_push_blocking(0);
+  multicore_fifo_pop_blocking(); // psx_sio is running
+
+  // then the controller type of the active profile and the last device
+  profilesLoad();
+  deviceExpect();
+  framePublish();
+
+  ledInit();
+
+  while (true) {
+    core1Pass();
+  }
+}
+
+// PS1 SIO slave state machine, see psx_sio.pio
+static PIO gSioPio;
+static uint gSioSm;
+static uint gSioOffset;
+
+#define SIO_FREQ 8000000.f
+
+// C23 enum with a fixed type; gcc before 13 builds the host tools without it
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 13
+#define ENUM_U8
+#else
+#define ENUM_U8 : uint8_t
+#endif
+
+enum EProt ENUM_U8 { PROT_NONE = 0, PROT_KEYB = 1, PROT_MOUSE = 2 };
+
+// Multitap (SCPH-1070): every connected device gets one of four slots. A
+// poll with 0x01 in byte 2 asks for the multitap reply in the next poll:
+// 0x80 0x5A, then 8 bytes per slot. Otherwise the slot that reported last is
+// served as a plain controller.
+#define MULTITAP 1
+#define PAD_SLOTS 4
+#define SLOT_SIZE 8
+#define TAP_SIZE (2 + PAD_SLOTS * SLOT_SIZE)
+
+// core1: latest input of a slot, motion as wrapping running totals
+typedef struct {
+  uint32_t totalX;
+  uint32_t totalY;
+  uint16_t buttons;
+  bool l;
+  bool r;
+  enum EProt prot;
+  MotionAxis motion[2]; // motion left over by motionApply()
+} InputState;
+
+static InputState gInputs[PAD_SLOTS] = {0};
+static uint8_t gActiveSlot = 0; // core1, slot that reported last
+static uint8_t gMouseSlot = 0;  // core1, slot of the mouse that moved last
+static bool gAnalog = false;    // core1, all slots are one analog pad
+static uint32_t gInputSeq = 0;  // core1, number of updates applied
+static bool gInputDirty = false; // core1, updates not published yet
+
+// core1 report path counters
+typedef struct {
+  uint32_t received;  // reports delivered by TinyUSB
+  uint32_t coalesced; // merged into input that was still waiting for publish
+  uint32_t dropped;   // not applied: unknown device or unparsable report
+} ReportStats;
+
+static ReportStats gReportStats = {0};
+
+// core1: arrival time of the last updates, indexed by seq
+#define UPDATE_TIMES 16
+static uint32_t gUpdateUs[UPDATE_TIMES];
+
+// Complete reply to a 0x42 poll, built by core1 ahead of time. sentX/sentY
+// are the motion totals the console has received once this frame went out;
+// baseX/baseY are the totals core0 had sent when the frame was built. The
+// same goes for seq/baseSeq and the number of input updates.
+typedef struct {
+  uint8_t data[TAP_SIZE + 4]; // multitap reply, then an idle or digital pad
+  uint8_t slot;               // slot served without multitap
+  uint8_t single;             // data offset of the reply without multitap
+  uint8_t singleSize;
+  bool merged; // analog pad of all slots in slot 0
+  uint32_t baseX[PAD_SLOTS];
+  uint32_t baseY[PAD_SLOTS];
+  uint32_t sentX[PAD_SLOTS];
+  uint32_t sentY[PAD_SLOTS];
+  uint32_t baseSeq;
+  uint32_t seq;
+  uint32_t oldestUs; // arrival of the oldest update not sent before
+} PadFrame;
+
+// Double buffer: core1 fills gFrames[(gFramePub + 1) & 1] and then bumps
+// gFramePub; core0 copies gFrames[gFramePub & 1] and retries if gFramePub
+// moved meanwhile. Neither core ever waits for the other.
+static PadFrame gFrames[2];
+static volatile uint32_t gFramePub = 0;
+
+// written by core0 when a poll is answered, read by core1
+static volatile uint32_t gSentX[PAD_SLOTS] = {0};
+static volatile uint32_t gSentY[PAD_SLOTS] = {0};
+static volatile uint32_t gSentSeq = 0;
+static volatile bool gTapMode = false; // the next poll gets a multitap reply
+static volatile uint32_t gPollUs = 0;   // time of the last answered poll
+static volatile uint32_t gPollStartUs = 0; // ATT fall of the same
+
+// core0 statistics, printed by core1
+typedef struct {
+  Hist age;    // age of the oldest unsent update when a poll is answered
+  Hist poll;   // console poll interval
+  Hist jitter; // change of the poll interval from one poll to the next
+  uint32_t lastPollUs;
+  uint32_t lastIntervalUs;
+} PollStats;
+
+static PollStats gPollStats = {
+    .age = {.shift = 10}, .poll = {.shift = 10}, .jitter = {.shift = 6}};
+
+// boot milestones in us since power-up, printed by core1. psxsim only shows
+// the order of events; the times are those measured on the hardware.
+typedef struct {
+  uint32_t sioUs;       // core0: answering the console
+  uint32_t firstPollUs; // core0: first poll answered
+  uint32_t validUs;     // core0: first poll answered as a controller
+  uint32_t mountUs;     // core1: first device attached
+  uint32_t descrUs;     // core1: its descriptor compiled
+  bool cached;          // core1: from the device cache
+} BootStats;
+
+static BootStats gBoot = {0};
+
+// saturate to the 8-bit range of a PS1 mouse delta
+int8_t sat8(int32_t a) {
+  if (a < -128)
+    a = -128;
+  if (a > 127)
+    a = 127;
+  return a;
+}
+
+// core1: limit the motion the console has not received yet
+void motionBacklogCap(uint32_t *total, uint32_t sent) {
+  const int32_t backlog = (int32_t)(*total - sent);
+  if (backlog > MOTION_BACKLOG_MAX) {
+    *total = sent + MOTION_BACKLOG_MAX;
+  } else if (backlog < -MOTION_BACKLOG_MAX) {
+    *total = sent - MOTION_BACKLOG_MAX;
+  }
+}
+
+// core1: build the 8-byte multitap slot s of frame f, returns the size of
+// its reply as a plain controller
+uint8_t slotBuild(PadFrame *f, uint8_t s, bool tap) {
+  InputState *in = gInputs + s;
+  uint8_t *d = f->data + 2 + s * SLOT_SIZE;
+  f->baseX[s] = gSentX[s];
+  f->baseY[s] = gSentY[s];
+  // motion not sent in mouse mode is dropped
+  f->sentX[s] = in->totalX;
+  f->sentY[s] = in->totalY;
+  memset(d, 0xFF, SLOT_SIZE);
+  if (in->prot == PROT_MOUSE) {
+    if (!tap && s != gActiveSlot) {
+      // not served, drop its motion as above
+      in->totalX = f->baseX[s];
+      in->totalY = f->baseY[s];
+    }
+    // at most 8 bits per poll, the rest goes out with the following ones
+    motionBacklogCap(&in->totalX, f->baseX[s]);
+    motionBacklogCap(&in->totalY, f->baseY[s]);
+    const int8_t dx = sat8((int32_t)(in->totalX - f->baseX[s]));
+    const int8_t dy = sat8((int32_t)(in->totalY - f->baseY[s]));
+    f->sentX[s] = f->baseX[s] + dx;
+    f->sentY[s] = f->baseY[s] + dy;
+    uint8_t buttons1 = 3;
+    if (in->l) {
+      buttons1 |= 8;
+    }
+    if (in->r) {
+      buttons1 |= 4;
+    }
+    d[0] = 0x12;
+    d[1] = 0x5A;
+    d[2] = 0xFF;
+    d[3] = ~buttons1;
+    d[4] = dx;
+    d[5] = dy;
+    return 6;
+  } else if (in->prot == PROT_KEYB) {
+    uint16_t buttons = in->buttons;
+    d[0] = 0x41;
+    d[1] = 0x5A;
+    d[2] = ~buttons;
+    d[3] = ~(buttons >> 8);
+    return 4;
+  }
+  return 0; // empty slot, all 0xFF
+}
+
+// core1: stick byte of the motion since the last poll. The motion of a poll
+// is the velocity the stick stands for; what is beyond full deflection is
+// carried over to the following polls.
+uint8_t analogAxis(uint32_t *total, uint32_t base, uint32_t *sent) {
+  const int32_t span = 127 - ANALOG_DEADZONE;
+  motionBacklogCap(total, base);
+  int32_t v = (int32_t)(*total - base);
+  v = v > span ? span : v < -span ? -span : v;
+  *sent = base + v;
+  if (v > 0) {
+    return 0x80 + ANALOG_DEADZONE + v;
+  } else if (v < 0) {
+    return 0x80 - ANALOG_DEADZONE + v;
+  }
+  return 0x80;
+}
+
+// full deflection towards the direction held, centre for none or both
+static inline uint8_t stickFromKeys(uint16_t buttons, uint16_t neg,
+                                    uint16_t pos) {
+  const uint16_t held = buttons & (neg | pos);
+  return held == neg ? 0x00 : held == pos ? 0xFF : 0x80;
+}
+
+// core1: merge every slot into one analog pad (0x73) in slot 0. Keys give
+// the buttons, the directions turn into the left stick, and the mouse that
+// moved last drives the right stick. The same pad in digital mode (0x41),
+// directions on the D-pad, goes after the multitap reply.
+uint8_t analogBuild(PadFrame *f) {
+  uint16_t buttons = 0;
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    InputState *in = gInputs + s;
+    f->baseX[s] = gSentX[s];
+    f->baseY[s] = gSentY[s];
+    if (in->prot != PROT_NONE) {
+      buttons |= in->buttons;
+    }
+    if (in->prot != PROT_MOUSE || s != gMouseSlot) {
+      // no motion from elsewhere
+      in->totalX = f->sentX[s] = f->baseX[s];
+      in->totalY = f->sentY[s] = f->baseY[s];
+    }
+  }
+  uint8_t *d = f->data + 2;
+  memset(d, 0xFF, PAD_SLOTS * SLOT_SIZE);
+  uint8_t rx = 0x80;
+  uint8_t ry = 0x80;
+  if (gInputs[gMouseSlot].prot == PROT_MOUSE) {
+    InputState *in = gInputs + gMouseSlot;
+    rx = analogAxis(&in->totalX, f->baseX[gMouseSlot], f->sentX + gMouseSlot);
+    ry = analogAxis(&in->totalY, f->baseY[gMouseSlot], f->sentY + gMouseSlot);
+  }
+  const uint8_t lx = stickFromKeys(buttons, PAD_LEFT, PAD_RIGHT);
+  const uint8_t ly = stickFromKeys(buttons, PAD_UP, PAD_DOWN);
+  uint8_t *digital = f->data + TAP_SIZE;
+  digital[0] = 0x41;
+  digital[1] = 0x5A;
+  digital[2] = ~buttons;
+  digital[3] = ~(buttons >> 8);
+  buttons &= ~PAD_DIRS;
+  d[0] = 0x73;
+  d[1] = 0x5A;
+  d[2] = ~buttons;
+  d[3] = ~(buttons >> 8);
+  d[4] = rx;
+  d[5] = ry;
+  d[6] = lx;
+  d[7] = ly;
+  return 8;
+}
+
+// core1: publish a frame for the current input
+void framePublish() {
+  PadFrame *f = gFrames + ((gFramePub + 1) & 1);
+  const bool tap = gTapMode;
+  f->baseSeq = gSentSeq;
+  f->seq = gInputSeq;
+  if (f->seq != f->baseSeq) {
+    uint32_t first = f->baseSeq + 1;
+    if (f->seq - first >= UPDATE_TIMES) {
+      first = f->seq - (UPDATE_TIMES - 1); // older ones are overwritten
+    }
+    f->oldestUs = gUpdateUs[first % UPDATE_TIMES];
+  }
+  f->data[0] = 0x80;
+  f->data[1] = 0x5A;
+  uint8_t sizes[PAD_SLOTS] = {0};
+  f->merged = gAnalog;
+  if (f->merged) {
+    sizes[0] = analogBuild(f);
+    f->slot = 0;
+  } else {
+    for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+      sizes[s] = slotBuild(f, s, tap);
+    }
+    f->slot = gActiveSlot;
+  }
+  if (sizes[f->slot]) {
+    f->single = 2 + f->slot * SLOT_SIZE;
+    f->singleSize = sizes[f->slot];
+  } else {
+    // nothing connected: idle digital pad
+    uint8_t *d = f->data + TAP_SIZE;
+    d[0] = 0x41;
+    d[1] = 0x5A;
+    d[2] = 0xFF;
+    d[3] = 0xFF;
+    f->single = TAP_SIZE;
+    f->singleSize = 4;
+  }
+  __dmb();
+  gFramePub = gFramePub + 1;
+}
+
+// has core0 answered a poll since the frame was built, as far as slot s goes
+static inline bool SRAM_FUNC(frameStale)(const PadFrame *f, uint8_t s) {
+  return f->baseSeq != gSentSeq || f->baseX[s] != gSentX[s] ||
+         f->baseY[s] != gSentY[s];
+}
+
+// core1: publish pending input, or rebuild the frame once core0 has sent
+// the motion it carries
+void frameRefresh() {
+  const PadFrame *f = gFrames + (gFramePub & 1);
+  bool stale = gInputDirty;
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    stale |= frameStale(f, s);
+  }
+  if (stale) {
+    gInputDirty = false;
+    framePublish();
+  }
+}
+
+// core1: an input update has been applied to slot s. Publishing waits for
+// frameRefresh(), so a burst of reports costs a single frame build.
+void SRAM_FUNC(inputUpdated)(uint8_t s) {
+  gActiveSlot = s;
+  ++gInputSeq;
+  gUpdateUs[gInputSeq % UPDATE_TIMES] = time_us_32();
+  if (gInputDirty) {
+    ++gReportStats.coalesced;
+  }
+  gInputDirty = true;
+}
+
+// core0: latch the current frame at the start of a transaction
+void SRAM_FUNC(frameTake)(PadFrame *frame) {
+  uint32_t pub;
+  do {
+    pub = gFramePub;
+    __dmb();
+    *frame = gFrames[pub & 1];
+    __dmb();
+  } while (pub != gFramePub);
+  bool stale = false;
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    if (frameStale(frame, s)) {
+      // built before the previous poll went out, its motion is already sent
+      uint8_t *d = frame->data + 2 + s * SLOT_SIZE;
+      if (d[0] == 0x12) {
+        d[4] = 0;
+        d[5] = 0;
       }
-      pio_sm_put_blocking(pio, sm, pixGRB << 8u);
+      frame->sentX[s] = gSentX[s];
+      frame->sentY[s] = gSentY[s];
+      stale = true;
+    }
+  }
+  if (frame->merged && stale) {
+    frame->data[2 + 4] = 0x80; // right stick back to centre
+    frame->data[2 + 5] = 0x80;
+  }
+  if (frame->baseSeq != gSentSeq) {
+    frame->baseSeq = frame->seq = gSentSeq;
+  }
+}
+
+// core0: the frame went out completely, later frames start from its totals
+void SRAM_FUNC(frameCommit)(const PadFrame *frame, bool tap) {
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    if (tap || frame->merged || s == frame->slot) {
+      gSentX[s] = frame->sentX[s];
+      gSentY[s] = frame->sentY[s];
     }
   }
+  gSentSeq = frame->seq;
 }
 
-enum EState : uint8_t { SM_A0 = 0, SM_A1 = 1, SM_A0C1 = 2, SM_A0C0 = 3 };
+// core0: account for an answered poll
+void SRAM_FUNC(pollStatsUpdate)(const PadFrame *frame) {
+  PollStats *st = &gPollStats;
+  const uint32_t now = time_us_32();
+  if (!st->lastPollUs) {
+    gBoot.firstPollUs = now;
+  }
+  if (!gBoot.validUs && (frame->merged || frame->single != TAP_SIZE)) {
+    gBoot.validUs = now; // not the idle pad of an empty port
+  }
+  if (frame->seq != frame->baseSeq) {
+    histAdd(&st->age, now - frame->oldestUs);
+  }
+  if (st->lastPollUs) {
+    const uint32_t interval = now - st->lastPollUs;
+    if (st->lastIntervalUs) {
+      histAdd(&st->jitter, interval > st->lastIntervalUs
+                               ? interval - st->lastIntervalUs
+                               : st->lastIntervalUs - interval);
+    }
+    histAdd(&st->poll, interval);
+    st->lastIntervalUs = interval;
+  }
+  st->lastPollUs = now;
+  gPollUs = now;
+}
 
 typedef struct {
-  enum EState state;
-  uint8_t bitIndex;
+  bool att;    // ATT level seen on the previous SM_task() pass
+  bool active; // transaction addressed to us and still being answered
+  bool done;   // every byte of the reply went out
+  bool tap;    // multitap reply
+  bool pad;    // merged analog pad, answers the commands of padcmd.h
+  bool poll;   // reply from the frame, carries input
   uint8_t byteIndex;
-  uint8_t cmd[2];
-  uint8_t data[10]; // mouse/pad data
-  uint8_t size;     // mouse/pad data size
+  uint8_t cmd;          // byte 1
+  uint8_t size;         // reply bytes after byte 0
+  const uint8_t *reply; // reply for byte N + 1 at reply[N]
+  uint8_t params[PAD_PARAMS];         // command bytes 3-8
+  uint8_t configPoll[PAD_REPLY_SIZE]; // poll reply in config mode
+  uint8_t clkEdges;                   // of byte 0 while calibrating
+  uint32_t clkSpanUs;                 // first to last of them
+  uint32_t rxUs[2];                   // bytes 0 and 1 received
+  uint32_t attUs;                     // ATT fell
+  PadFrame frame;                     // latched when ATT fell
 } ConSM;
 
 static ConSM gSM;
+static PadMode gPad;            // core0
+static SioTiming gSioTiming;    // core0
+static uint32_t gSioTimingBits; // ACK width and delay in a verdict word
 
-enum EProt : uint8_t { PROT_NONE = 0, PROT_KEYB = 1, PROT_MOUSE = 2 };
+// give up on counting CLK edges if byte 0 takes longer
+#define SIO_SAMPLE_US 200
 
-static enum EProt gContrProt = PROT_NONE;
+// verdict word for psx_sio, see sioVerdict()
+static inline uint32_t SRAM_FUNC(SIO_verdict)(bool ack, uint8_t next) {
+  return sioVerdict(ack, next, gSioTimingBits);
+}
 
-static int8_t gSumX = 0;
-static int8_t gSumY = 0;
-static bool gL = false;
-static bool gR = false;
+static void SRAM_FUNC(SIO_timingUpdate)() {
+  gSioTimingBits = sioVerdictTiming(gSioTiming.width, gSioTiming.delay);
+}
 
-static uint16_t gButtons = 0;
+// park the state machine at the start of a transaction, DAT and ACK released,
+// with the (always idle) response for byte 0 queued
+void SRAM_FUNC(SIO_reset)() {
+  pio_sm_set_enabled(gSioPio, gSioSm, false);
+  pio_sm_clear_fifos(gSioPio, gSioSm);
+  pio_sm_restart(gSioPio, gSioSm);
+  // DAT by the SET pins, ACK by side-set; pio_sm_set_pindirs_with_mask()
+  // would do the same from flash
+  pio_sm_exec(gSioPio, gSioSm,
+              pio_encode_set(pio_pindirs, 0) | pio_encode_sideset_opt(1, 0));
+  pio_sm_exec(gSioPio, gSioSm,
+              pio_encode_jmp(gSioOffset + psx_sio_offset_start));
+  pio_sm_put(gSioPio, gSioSm, sioFirstWord(0xFF, gSioTiming.delay));
+  pio_sm_set_enabled(gSioPio, gSioSm, true);
+}
 
-// sum with saturation
-int8_t sumSat(int8_t a, int8_t b) {
-  int16_t ret = (int16_t)a + (int16_t)b;
-  if (ret < -128)
-    ret = -128;
-  if (ret > 127)
-    ret = 127;
-  return ret;
+void SIO_init() {
+  bool success = pio_claim_free_sm_and_add_program_for_gpio_range(
+      &psx_sio_program, &gSioPio, &gSioSm, &gSioOffset, GP_ATT,
+      GP_ACK - GP_ATT + 1, true);
+  hard_assert(success);
+
+  psx_sio_program_init(gSioPio, gSioSm, gSioOffset, GP_CMD, GP_DAT, GP_ACK,
+                       SIO_FREQ);
+  sioTimingInit(&gSioTiming);
+  SIO_timingUpdate();
+  SIO_reset();
 }
 
 void SM_init() {
-  if (gpio_get(GP_ATT)) {
-    gSM.state = SM_A1;
+  gSM.att = gpio_get(GP_ATT);
+  gSM.active = false;
+  padModeInit(&gPad);
+}
+
+// poll reply of the merged pad in its current mode
+static void SRAM_FUNC(SM_padPoll)() {
+  const uint8_t *d = gSM.frame.data + 2;
+  if (gPad.config) {
+    memcpy(gSM.configPoll, d, PAD_REPLY_SIZE);
+    gSM.configPoll[0] = PAD_ID_CONFIG;
+    gSM.reply = gSM.configPoll;
+    gSM.size = PAD_REPLY_SIZE;
+  } else if (gPad.analog) {
+    gSM.reply = d;
+    gSM.size = PAD_REPLY_SIZE;
   } else {
-    gSM.state = SM_A0;
+    gSM.reply = gSM.frame.data + TAP_SIZE;
+    gSM.size = 4;
   }
 }
 
-void SM_task() {
-  switch (gSM.state) {
-  case SM_A0: {
-    gpio_set_dir(GP_DAT, GPIO_IN);
-    if (gpio_get(GP_ATT)) {
-      gSM.state = SM_A1;
+// Counts the falling CLK edges of byte 0 until psx_sio has received it. Only
+// while calibrating: the verdict for byte 0 still goes out in time, the
+// busy wait ends right when the byte is in.
+static void SRAM_FUNC(SM_clockSample)() {
+  const uint32_t start = time_us_32();
+  uint32_t first = 0;
+  uint32_t last = 0;
+  uint8_t edges = 0;
+  bool clk = true;
+  gSM.clkEdges = 0;
+  while (pio_sm_is_rx_fifo_empty(gSioPio, gSioSm)) {
+    const uint32_t now = time_us_32();
+    if (now - start > SIO_SAMPLE_US) {
+      return;
     }
-    break;
-  }
-  case SM_A1: {
-    gpio_set_dir(GP_DAT, GPIO_IN);
-    if (!gpio_get(GP_ATT)) {
-      gSM.bitIndex = gSM.byteIndex = 0;
-      gSM.cmd[0] = gSM.cmd[1] = 0;
-      gSM.state = SM_A0C1;
+    const bool c = gpio_get(GP_CLK);
+    if (clk && !c) {
+      if (edges++ == 0) {
+        first = now;
+      }
+      last = now;
     }
-    break;
+    clk = c;
   }
-  case SM_A0C1: {
-    if (!gpio_get(GP_CLK)) {
-      gSM.state = SM_A0C0;
-      // falling edge clock
-      if (gSM.byteIndex > 0 && gSM.byteIndex <= gSM.size) {
-        if (gSM.data[gSM.byteIndex - 1] & (1 << gSM.bitIndex)) {
-          gpio_set_dir(GP_DAT, GPIO_IN);
-        } else {
-          gpio_set_dir(GP_DAT, GPIO_OUT);
-        }
+  gSM.rxUs[0] = time_us_32();
+  gSM.clkEdges = edges;
+  gSM.clkSpanUs = last - first;
+}
+
+// Measures the first transactions, then watches that replies still go out
+// completely with the adapted timing.
+static void SRAM_FUNC(SM_timingCheck)() {
+  bool changed;
+  if (gSioTiming.state == SIO_CAL_MEASURING) {
+    changed = gSM.clkEdges &&
+              sioTimingSample(&gSioTiming, gSM.clkEdges, gSM.clkSpanUs,
+                              gSM.rxUs[1] - gSM.rxUs[0]);
+  } else {
+    changed = sioTimingResult(&gSioTiming, gSM.done);
+  }
+  if (changed) {
+    SIO_timingUpdate();
+  }
+}
+
+// Bit shifting and ACK timing are done by psx_sio; only the byte level
+// protocol is handled here. The verdict for a byte has to be queued before
+// the ACK delay of the state machine runs out, so replies are only picked
+// from what was built before: at ATT fall the poll reply, whose ID byte goes
+// out with byte 1, then the reply to the command in byte 1 and its variant
+// for the parameter in byte 3. Mode changes wait for ATT to rise.
+void SRAM_FUNC(SM_task)() {
+  const bool att = gpio_get(GP_ATT);
+  if (att) {
+    if (!gSM.att) {
+      // end of transaction (or aborted one)
+      if (gSM.byteIndex >= 2) {
+        SM_timingCheck(); // the reset word carries the ACK delay
+      }
+      SIO_reset();
+      gSM.active = false;
+      // motion counts as sent once the whole reply went out; cut short,
+      // the next frame carries it again
+      if (gSM.done && gSM.poll) {
+        frameCommit(&gSM.frame, gSM.tap);
+      }
+      if (gSM.done && gSM.pad) {
+        padCommandDone(&gPad, gSM.cmd, gSM.params);
       }
-    } else if (gpio_get(GP_ATT)) {
-      gSM.state = SM_A1;
+      gSM.done = false;
+    }
+    gSM.att = true;
+    return;
+  }
+  if (gSM.att) {
+    gSM.att = false;
+    gSM.attUs = time_us_32();
+    gSM.active = true;
+    gSM.byteIndex = 0;
+    gSM.poll = true;
+    memset(gSM.params, 0, sizeof(gSM.params));
+    frameTake(&gSM.frame);
+    gSM.tap = gTapMode;
+    gSM.pad = gSM.frame.merged && !gSM.tap;
+    if (!gSM.frame.merged && (gPad.config || !gPad.analog)) {
+      padModeInit(&gPad); // the pad went away, a new one starts afresh
+    }
+    if (gSM.tap) {
+      gSM.reply = gSM.frame.data;
+      gSM.size = TAP_SIZE;
+    } else if (gSM.pad) {
+      SM_padPoll();
+    } else {
+      gSM.reply = gSM.frame.data + gSM.frame.single;
+      gSM.size = gSM.frame.singleSize;
+    }
+    if (gSioTiming.state == SIO_CAL_MEASURING) {
+      SM_clockSample();
     }
-    break;
   }
-  case SM_A0C0: {
-    if (gpio_get(GP_CLK)) {
-      gSM.state = SM_A0C1;
-      // rising edge clock
-      if (gpio_get(GP_CMD)) {
-        if (gSM.byteIndex < 2) {
-          gSM.cmd[gSM.byteIndex] |= 1 << (gSM.bitIndex);
-        }
-      }
-      ++gSM.bitIndex;
-      if (gSM.bitIndex == 8) {
-        gSM.bitIndex = 0;
-        // sleep_us(11);
-        sleep_us(15);
-        gpio_set_dir(GP_DAT, GPIO_IN);
-        if (gSM.byteIndex < gSM.size) {
-          gpio_set_dir(GP_ACK, GPIO_OUT);
-          // sleep_us(3);
-          sleep_us(4);
-          gpio_set_dir(GP_ACK, GPIO_IN);
-        }
 
-        if (gSM.byteIndex == 0) {
-          if (gSM.cmd[gSM.byteIndex] != 1) {
-            gSM.state = SM_A0;
-            break;
-          } else {
-            mutex_enter_blocking(&mtx);
-            if (gContrProt == PROT_MOUSE) {
-              uint8_t buttons1 = 3;
-              int8_t sumX = gSumX;
-              gSumX = 0;
-              int8_t sumY = gSumY;
-              gSumY = 0;
-              if (gL) {
-                buttons1 |= 8;
-              }
-              if (gR) {
-                buttons1 |= 4;
-              }
-              mutex_exit(&mtx);
-              gSM.size = 6;
-              gSM.data[0] = 0x12;
-              gSM.data[1] = 0x5A;
-              gSM.data[2] = 0xFF;
-              gSM.data[3] = ~buttons1;
-              gSM.data[4] = sumX;
-              gSM.data[5] = sumY;
-            } else if (gContrProt == PROT_KEYB) {
-              uint16_t buttons = gButtons;
-              mutex_exit(&mtx);
-              gSM.size = 4;
-              gSM.data[0] = 0x41;
-              gSM.data[1] = 0x5A;
-              gSM.data[2] = ~buttons;
-              gSM.data[3] = ~(buttons >> 8);
-            } else {
-              mutex_exit(&mtx);
-              gSM.size = 4;
-              gSM.data[0] = 0x41;
-              gSM.data[1] = 0x5A;
-              gSM.data[2] = 0xFF;
-              gSM.data[3] = 0xFF;
-            }
-          }
-        } else if (gSM.byteIndex == 1) {
-          if (gSM.cmd[gSM.byteIndex] != 0x42) {
-            gSM.state = SM_A0;
-            break;
-          }
-        }
-        ++gSM.byteIndex;
-      }
-    } else if (gpio_get(GP_ATT)) {
-      gSM.state = SM_A1;
+  if (!gSM.active || pio_sm_is_rx_fifo_empty(gSioPio, gSioSm)) {
+    return;
+  }
+
+  const uint8_t cmd = pio_sm_get(gSioPio, gSioSm) >> 24;
+  if (gSM.byteIndex == 1) {
+    gSM.rxUs[1] = time_us_32();
+  }
+
+  if (gSM.byteIndex == 0) {
+    if (cmd != 1) {
+      // not for a controller, e.g. memory card access
+      pio_sm_put(gSioPio, gSioSm, SIO_verdict(false, 0xFF));
+      gSM.active = false;
+#if DEBUG_TRACE
+      traceEvent(TRACE_POLL_IGNORED, 0, 0, cmd, 0, 0, 0, NULL, 0);
+#endif
+      return;
     }
-    break;
+  } else if (gSM.byteIndex == 1) {
+    const int r = gSM.pad                 ? padReply(&gPad, cmd, 0)
+                  : cmd == PAD_CMD_POLL ? PAD_REPLY_POLL
+                                        : -1;
+    if (r < 0) {
+      pio_sm_put(gSioPio, gSioSm, SIO_verdict(false, 0xFF));
+      gSM.active = false;
+#if DEBUG_TRACE
+      traceEvent(TRACE_POLL_IGNORED, 0, 0, cmd, 0, 1, 0, NULL, 0);
+#endif
+      return;
+    }
+    gSM.cmd = cmd;
+    gSM.poll = r == PAD_REPLY_POLL;
+    if (!gSM.poll) {
+      // same ID and 0x5A as the poll reply, only later bytes differ
+      gSM.reply = gPad.replies[r];
+      gSM.size = PAD_REPLY_SIZE;
+    }
+  } else if (gSM.byteIndex - 3u < PAD_PARAMS) {
+    gSM.params[gSM.byteIndex - 3] = cmd;
+    if (gSM.byteIndex == 3 && !gSM.poll) {
+      // the variants share the bytes up to reply[3]
+      gSM.reply = gPad.replies[padReply(&gPad, gSM.cmd, cmd)];
+    }
+  }
+
+  // byte N of the transaction carries reply[N - 1]; the last one is not ACKed
+  if (gSM.byteIndex < gSM.size) {
+    pio_sm_put(gSioPio, gSioSm, SIO_verdict(true, gSM.reply[gSM.byteIndex]));
+    ++gSM.byteIndex;
+    // bookkeeping after the verdict, off the ACK path
+    if (gSM.byteIndex == 2 && gSM.poll) {
+      pollStatsUpdate(&gSM.frame);
+      gPollStartUs = gSM.attUs;
+#if DEBUG_TRACE
+      traceEvent(TRACE_POLL, 0, 0, 0, 0, 0, 0, gSM.reply, gSM.size);
+#endif
+    } else if (gSM.byteIndex == 2) {
+      gPollUs = time_us_32(); // the console is busy all the same
+    } else if (gSM.byteIndex == 3 && gSM.cmd == PAD_CMD_POLL) {
+      // byte 2 = 0x01 asks for the multitap reply next time
+      gTapMode = MULTITAP && cmd == 0x01;
+    }
+  } else {
+    pio_sm_put(gSioPio, gSioSm, SIO_verdict(false, 0xFF));
+    gSM.active = false;
+    gSM.done = gSM.byteIndex == gSM.size;
+  }
+}
+
+#if DEBUG_STDOUT
+// core0: loop passes timed in cycles of the free running SysTick. Passes that
+// measure the SIO clock wait for byte 0 and are left out; a profile save parks
+// core0 and shows up as one slow pass. A verdict goes out within two passes of
+// its byte arriving, so loop_max_ns bounds the worst-case response on the
+// RP2040; psxsim -l estimates the same with the old mutex.
+#define LOOP_SLOW_CYCLES 600 // 5 us at 120 MHz
+
+typedef struct {
+  uint32_t last; // SysTick at the end of the previous pass, counts down
+  uint32_t passes;
+  uint32_t slow; // passes over LOOP_SLOW_CYCLES
+  uint32_t maxCycles;
+} LoopTime;
+
+static LoopTime gCore0Loop;
+
+static void loopTimeInit() {
+  // set up as in captureInit(), unless that did already
+  if (!(systick_hw->csr & 1)) {
+    systick_hw->rvr = 0x00ffffff;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 5; // CLKSOURCE | ENABLE
+  }
+  gCore0Loop.last = systick_hw->cvr;
+}
+
+static inline void SRAM_FUNC(loopTimeAdd)() {
+  const uint32_t now = systick_hw->cvr;
+  const uint32_t cycles = (gCore0Loop.last - now) & 0x00ffffff;
+  gCore0Loop.last = now;
+  if (gSioTiming.state == SIO_CAL_MEASURING) {
+    return;
+  }
+  ++gCore0Loop.passes;
+  if (cycles > LOOP_SLOW_CYCLES) {
+    ++gCore0Loop.slow;
   }
+  if (cycles > gCore0Loop.maxCycles) {
+    gCore0Loop.maxCycles = cycles;
+  }
+}
+#endif
+
+// core0: the SIO loop, in SRAM like everything it calls
+static void SRAM_NOINLINE(core0Loop)() {
+#if DEBUG_STDOUT
+  loopTimeInit();
+#endif
+  while (true) {
+    SM_task();
+#if PSX_CAPTURE
+    captureSample();
+#endif
+#if DEBUG_STDOUT
+    loopTimeAdd();
+#endif
   }
 }
 
@@ -337,13 +1055,20 @@ int main(void) {
 
   sleep_ms(10);
 
-#if DEBUG_STDOUT
+#if DEBUG_STDOUT || PSX_CAPTURE || DEBUG_TRACE
   stdio_init_all();
 #endif
+#if DEBUG_TRACE
+  traceInit();
+#endif
 
   multicore_reset_core1();
   // all USB task run in core1
   multicore_launch_core1(core1_main);
+  // wait for the first reply and PIO-USB's programs
+  multicore_fifo_pop_blocking();
+  // core1 writes the profile store, core0 waits in RAM meanwhile
+  flash_safe_execute_core_init();
 
   gpio_init(GP_ATT);
   gpio_set_dir(GP_ATT, GPIO_IN);
@@ -364,11 +1089,17 @@ int main(void) {
   gpio_set_dir(GP_ACK, GPIO_IN);
   gpio_clr_mask((1 << GP_ACK));
 
+  SIO_init();
   SM_init();
+  gBoot.sioUs = time_us_32();
+  // psx_sio is loaded, core1 may read the store
+  multicore_fifo_push_blocking(0);
 
-  while (true) {
-    SM_task();
-  }
+#if PSX_CAPTURE
+  captureInit();
+#endif
+
+  core0Loop();
 
   return 0;
 }
@@ -377,64 +1108,635 @@ int main(void) {
 // Host HID
 //--------------------------------------------------------------------+
 
-bool testKeyboardDescr(const volatile uint8_t *descr, uint32_t descrLen) {
-  return descrLen > 4 && descr[0] == 0x05 && descr[1] == 0x01 &&
-         descr[2] == 0x09 && descr[3] == 0x06;
+// Profile store: the last sectors of flash, see profile.h
+#define PROFILE_SECTORS 4
+#define PROFILE_OFFSET                                                         \
+  (PICO_FLASH_SIZE_BYTES - PROFILE_SECTORS * FLASH_SECTOR_SIZE)
+
+// chord selecting profile i: left Ctrl + left Alt + F1 + i
+#define CHORD_CTRL 0xE0
+#define CHORD_ALT 0xE2
+#define CHORD_F1 0x3A
+
+typedef struct {
+  uint32_t offset;
+  const uint8_t *page;
+} FlashOp;
+
+static void flashErase(void *param) {
+  const FlashOp *op = param;
+  flash_range_erase(PROFILE_OFFSET + op->offset, FLASH_SECTOR_SIZE);
+}
+
+static void flashProgram(void *param) {
+  const FlashOp *op = param;
+  flash_range_program(PROFILE_OFFSET + op->offset, op->page, FLASH_PAGE_SIZE);
+}
+
+static void profileErase(uint32_t offset) {
+  FlashOp op = {offset, NULL};
+  flash_safe_execute(flashErase, &op, 10);
+}
+
+static void profileProgram(uint32_t offset, const uint8_t *page) {
+  FlashOp op = {offset, page};
+  flash_safe_execute(flashProgram, &op, 10);
+}
+
+static_assert(PROFILE_PAGE == FLASH_PAGE_SIZE, "profile record is one page");
+
+static const ProfileFlash gProfileFlash = {
+    .base = (const uint8_t *)XIP_BASE + PROFILE_OFFSET,
+    .size = PROFILE_SECTORS * FLASH_SECTOR_SIZE,
+    .sectorSize = FLASH_SECTOR_SIZE,
+    .erase = profileErase,
+    .program = profileProgram,
+};
+
+// core1
+static ProfileStore gProfileStore;
+static const Profile *gProfile = gProfileStore.profiles;
+static MotionCurve gMotion; // of gProfile
+
+// gKeyMasks[b] has the bits of all keys mapped to button b, by keyboard usage;
+// switching profiles only moves the pointer
+static KeyBits gProfileMasks[PROFILES][16];
+static const KeyBits *gKeyMasks = gProfileMasks[0];
+
+// profile of the built-in KEY_BUTTON_MAP, so a patched map still applies
+void profileFromKeyMap(Profile *p) {
+  memset(p, 0, sizeof(*p));
+  p->mouseSpeed = PROFILE_SPEED_1X;
+  for (uint32_t key = 0; key != 256 && p->keyCount != PROFILE_KEYS; ++key) {
+    uint16_t bits = KEY_PTR[key];
+    if (key >= 0xE0 && key <= 0xE7) {
+      bits |= MOD_PTR[key - 0xE0]; // modifiers have their own entries
+    }
+    if (bits) {
+      p->keys[p->keyCount].key = key;
+      p->keys[p->keyCount].buttons = bits;
+      ++p->keyCount;
+    }
+  }
+  // mouse buttons in analog mode
+  const KeyBinding mouse[2] = {{PROFILE_KEY_MOUSE_LEFT, 0, PAD_R1},
+                               {PROFILE_KEY_MOUSE_RIGHT, 0, PAD_L1}};
+  for (uint32_t i = 0; i != 2 && p->keyCount != PROFILE_KEYS; ++i) {
+    p->keys[p->keyCount++] = mouse[i];
+  }
 }
 
-bool parseKeyboardData(const uint8_t *data, uint32_t dataLen,
-                       uint16_t *buttonsPtr) {
-  if (dataLen != 8) {
-    return false;
+void profileMasks(const Profile *p, KeyBits masks[16]) {
+  memset(masks, 0, 16 * sizeof(KeyBits));
+  for (uint32_t i = 0; i != p->keyCount; ++i) {
+    const uint8_t key = p->keys[i].key;
+    for (uint32_t b = 0; b != 16; ++b) {
+      if (p->keys[i].buttons & (1 << b)) {
+        masks[b][key >> 5] |= 1u << (key & 31);
+      }
+    }
   }
-  if (data[2] == 1 || data[3] == 1 || data[4] == 1 || data[5] == 1 ||
-      data[6] == 1 || data[7] == 1) {
-    return false;
+}
+
+// all pressed keys of an interface
+void SRAM_FUNC(keysDown)(const KeyBits keys[KEYB_REPORTS], KeyBits down) {
+  for (uint32_t w = 0; w != 8; ++w) {
+    down[w] = 0;
+    for (uint32_t r = 0; r != KEYB_REPORTS; ++r) {
+      down[w] |= keys[r][w];
+    }
   }
+}
+
+// buttons of the pressed keys in the active profile
+uint16_t SRAM_FUNC(keyButtons)(const KeyBits down) {
   uint16_t buttons = 0;
-  for (int i = 0; i != 8; ++i) {
-    if (data[0] & (1 << i)) {
-      buttons |= MOD_PTR[i];
+  for (uint32_t b = 0; b != 16; ++b) {
+    uint32_t hit = 0;
+    for (uint32_t w = 0; w != 8; ++w) {
+      hit |= down[w] & gKeyMasks[b][w];
     }
+    buttons |= (uint16_t)(hit != 0) << b;
   }
-  for (int i = 2; i != 8; ++i) {
-    if (data[i]) {
-      buttons |= KEY_PTR[data[i]];
+  return buttons;
+}
+
+// pad buttons of the mouse buttons, through their reserved key usages
+uint16_t SRAM_FUNC(mouseButtons)(const InputState *in) {
+  const uint32_t l = PROFILE_KEY_MOUSE_LEFT;
+  const uint32_t r = PROFILE_KEY_MOUSE_RIGHT;
+  KeyBits down = {0};
+  down[l >> 5] |= (uint32_t)in->l << (l & 31);
+  down[r >> 5] |= (uint32_t)in->r << (r & 31);
+  return keyButtons(down);
+}
+
+void profileActivate(uint8_t i) {
+  gKeyMasks = gProfileMasks[i];
+  gProfile = gProfileStore.profiles + i;
+  gAnalog = gProfile->flags & PROFILE_ANALOG;
+  motionCurveBuild(&gMotion, &gProfile->motion,
+                   gProfile->mouseSpeed * (MOTION_GAIN_1X / PROFILE_SPEED_1X));
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    if (gInputs[s].prot == PROT_MOUSE) {
+      gInputs[s].buttons = mouseButtons(gInputs + s);
     }
   }
-  *buttonsPtr = buttons;
-  return true;
+  gInputDirty = true;
+}
+
+// core1: built-in map for every profile until the store is read
+void profilesInit() {
+  for (uint8_t i = 0; i != PROFILES; ++i) {
+    profileFromKeyMap(gProfileStore.profiles + i);
+  }
+  profileMasks(gProfileStore.profiles, gProfileMasks[0]);
+  for (uint8_t i = 1; i != PROFILES; ++i) {
+    memcpy(gProfileMasks[i], gProfileMasks[0], sizeof(gProfileMasks[0]));
+  }
+}
+
+// core1: profiles saved in flash replace the built-in ones
+void profilesLoad() {
+  profileLoad(&gProfileStore, &gProfileFlash);
+  for (uint8_t i = 0; i != PROFILES; ++i) {
+    profileMasks(gProfileStore.profiles + i, gProfileMasks[i]);
+  }
+  profileActivate(gProfileStore.active);
+}
+
+static inline bool SRAM_FUNC(keyDown)(const KeyBits down, uint8_t key) {
+  return down[key >> 5] & (1u << (key & 31));
 }
 
+// core1: profile switch chord; the choice is saved with the next poll
+void SRAM_FUNC(profileChord)(const KeyBits down) {
+  if (!keyDown(down, CHORD_CTRL) || !keyDown(down, CHORD_ALT)) {
+    return;
+  }
+  for (uint8_t i = 0; i != PROFILES; ++i) {
+    if (keyDown(down, CHORD_F1 + i) && i != gProfileStore.active) {
+      profileSelect(&gProfileStore, i);
+      profileActivate(i);
+    }
+  }
+}
+
+// A mounted HID interface. Its descriptor is compiled both ways: the mouse
+// part from the Mouse collections, the keyboard part from the keys anywhere
+// in it, so a receiver with both on one interface feeds a mouse slot and a
+// keyboard slot at once. routes sends each report to its part by report ID.
 typedef struct {
-  uint8_t protocol;
+  uint8_t protocols; // PROT_MOUSE and PROT_KEYB bits of the parts in use
   uint8_t dev_addr;
   uint8_t instance;
-  MouseConf mouse;
+  uint8_t mouseSlot; // multitap slot of each part
+  uint8_t keybSlot;
+  uint8_t hasIds;      // reports start with their ID
+  uint8_t routes[256]; // parts by report ID, 0 without IDs
+  MouseConf mouse;     // PROT_MOUSE
+  KeybConf keyb;       // PROT_KEYB
+  KeyBits keys[KEYB_REPORTS]; // PROT_KEYB: pressed keys per report
+  uint16_t buttons;           // PROT_KEYB: buttons of keys
+  uint32_t lastReportUs;
+  uint32_t lastMouseUs; // PROT_MOUSE: for the speed of the motion stage
+  Hist reportInterval;
+  bool moved;        // PROT_MOUSE: the last report had motion
+  uint32_t armUs;    // PROT_MOUSE: report asked for
+  uint32_t targetUs; // PROT_MOUSE: poll it is for, 0 = none predicted
+  uint32_t leadUs;   // PROT_MOUSE: how long a moving mouse takes to report
 } USBDev;
 
-#define gUSBDevsCount 8
-static USBDev gUSBDevs[gUSBDevsCount] = {{0}, {0}, {0}, {0},
-                                         {0}, {0}, {0}, {0}};
+// Registry of the mounted HID interfaces, one entry per interface TinyUSB
+// can have open. gDevIndex maps (dev_addr, instance) straight to entry + 1,
+// 0 for none, whether instances count per device or across all of them;
+// gDevUsed has a bit per entry in use. Zeroed at start-up, core1 only.
+#define gUSBDevsCount CFG_TUH_HID
+#define DEV_ADDRS (CFG_TUH_DEVICE_MAX + CFG_TUH_HUB + 1) // 0 is not used
 
-USBDev *findEmptyDev() {
+static_assert(gUSBDevsCount <= 32, "gDevUsed has a bit per entry");
+
+static USBDev gUSBDevs[gUSBDevsCount];
+static uint8_t gDevIndex[DEV_ADDRS][CFG_TUH_HID];
+static uint32_t gDevUsed = 0;
+static uint8_t gSlotUsers[PAD_SLOTS] = {0}; // entries in use per slot
+static uint32_t gDevParked = 0; // mice waiting for pollAlignTask(), by entry
+static uint32_t gDevBoot = 0;   // boot interfaces waiting for bootTask()
+
+// core1: the console's poll rhythm, see pollAlignTask()
+typedef struct {
+  PollTrack track;
+  uint32_t pollStartUs; // the last poll fed to track
+  uint32_t late;        // mouse reports after the poll they were asked for
+} PollAlign;
+
+static PollAlign gAlign;
+static bool gPollAlign = POLL_ALIGN;
+
+// core1
+void latencyPrint() {
+  const uint64_t currentTime = to_us_since_boot(get_absolute_time());
+  printf("{\"event\":\"latency\",\"timestamp\":\"%" PRIu64 "\"", currentTime);
+  histPrint("age", &gPollStats.age);
+  histPrint("poll", &gPollStats.poll);
+  histPrint("jitter", &gPollStats.jitter);
+  printf(",\"reports_received\":\"%lu\",\"reports_coalesced\":\"%lu\","
+         "\"reports_dropped\":\"%lu\",\"sio_period_ns\":\"%lu\","
+         "\"ack_delay_us\":\"%u\",\"ack_width_us\":\"%u\"",
+         (unsigned long)gReportStats.received,
+         (unsigned long)gReportStats.coalesced,
+         (unsigned long)gReportStats.dropped,
+         (unsigned long)gSioTiming.periodNs, gSioTiming.delay + 1u,
+         gSioTiming.width + 1u);
+  printf(",\"poll_period_us\":\"%lu\",\"poll_locked\":\"%u\","
+         "\"align_late\":\"%lu\"",
+         (unsigned long)(gAlign.track.periodQ4 >> 4),
+         gAlign.track.hits >= POLL_TRACK_LOCK, (unsigned long)gAlign.late);
+  printf(",\"boot_sio_us\":\"%lu\",\"boot_first_poll_us\":\"%lu\","
+         "\"boot_valid_us\":\"%lu\",\"boot_mount_us\":\"%lu\","
+         "\"boot_descr_us\":\"%lu\",\"boot_descr_cached\":\"%u\"},\n",
+         (unsigned long)gBoot.sioUs, (unsigned long)gBoot.firstPollUs,
+         (unsigned long)gBoot.validUs, (unsigned long)gBoot.mountUs,
+         (unsigned long)gBoot.descrUs, gBoot.cached);
+#if DEBUG_STDOUT
+  printf("{\"event\":\"core0\",\"timestamp\":\"%" PRIu64 "\","
+         "\"sram_hot\":\"%u\",\"loop_passes\":\"%lu\",\"loop_slow\":\"%lu\","
+         "\"loop_max_cycles\":\"%lu\",\"loop_max_ns\":\"%lu\"},\n",
+         currentTime, SRAM_HOT, (unsigned long)gCore0Loop.passes,
+         (unsigned long)gCore0Loop.slow, (unsigned long)gCore0Loop.maxCycles,
+         (unsigned long)((uint64_t)gCore0Loop.maxCycles * 1000000000u /
+                         clock_get_hz(clk_sys)));
+#endif
+  printf("{\"event\":\"core1\",\"timestamp\":\"%" PRIu64 "\"", currentTime);
+  histPrint("usb_gap", &gUsbGap);
+  printf("},\n");
+  for (uint32_t i = 0; i != TASKS; ++i) {
+    const Core1Task *t = gTasks + i;
+    printf("{\"event\":\"core1_task\",\"timestamp\":\"%" PRIu64 "\","
+           "\"name\":\"%s\",\"runs\":\"%lu\",\"busy_us\":\"%" PRIu64 "\","
+           "\"max_us\":\"%lu\"},\n",
+           currentTime, t->name, (unsigned long)t->runs, t->busyUs,
+           (unsigned long)t->maxUs);
+  }
   for (uint8_t i = 0; i != gUSBDevsCount; ++i) {
-    if (gUSBDevs[i].protocol == PROT_NONE) {
-      return gUSBDevs + i;
+    const USBDev *usbdev = gUSBDevs + i;
+    if (usbdev->protocols != PROT_NONE) {
+      printf("{\"event\":\"report_interval\",\"timestamp\":\"%" PRIu64 "\","
+             "\"address\":\"%u\",\"instance\":\"%u\",\"protocols\":\"%u\"",
+             currentTime, usbdev->dev_addr, usbdev->instance,
+             usbdev->protocols);
+      histPrint("interval", &usbdev->reportInterval);
+      printf("},\n");
     }
   }
-  return NULL;
 }
 
-USBDev *findDev(uint8_t dev_addr, uint8_t instance) {
-  for (uint8_t i = 0; i != gUSBDevsCount; ++i) {
-    if (gUSBDevs[i].dev_addr == dev_addr && gUSBDevs[i].instance == instance) {
-      return gUSBDevs + i;
+static inline bool SRAM_FUNC(devKeyValid)(uint8_t dev_addr,
+                                          uint8_t instance) {
+  return dev_addr < DEV_ADDRS && instance < CFG_TUH_HID;
+}
+
+// entry of a mounted interface, NULL if there is none
+USBDev *SRAM_FUNC(findDev)(uint8_t dev_addr, uint8_t instance) {
+  if (!devKeyValid(dev_addr, instance)) {
+    return NULL;
+  }
+  const uint8_t e = gDevIndex[dev_addr][instance];
+  return e ? gUSBDevs + e - 1 : NULL;
+}
+
+// a free entry to compile a descriptor into, claimed by devClaim()
+USBDev *findEmptyDev() {
+  if (gDevUsed == (uint32_t)((1ull << gUSBDevsCount) - 1)) {
+    return NULL;
+  }
+  return gUSBDevs + __builtin_ctz(~gDevUsed);
+}
+
+// the entry no longer matches its (dev_addr, instance)
+void devRelease(USBDev *usbdev) {
+  const uint32_t e = usbdev - gUSBDevs;
+  gDevIndex[usbdev->dev_addr][usbdev->instance] = 0;
+  gDevUsed &= ~(1u << e);
+  gDevParked &= ~(1u << e);
+  gDevBoot &= ~(1u << e);
+  if (usbdev->protocols & PROT_MOUSE) {
+    --gSlotUsers[usbdev->mouseSlot];
+  }
+  if (usbdev->protocols & PROT_KEYB) {
+    --gSlotUsers[usbdev->keybSlot];
+  }
+  usbdev->protocols = PROT_NONE;
+  usbdev->dev_addr = 0;
+  usbdev->instance = 0;
+}
+
+static inline bool slotUsed(uint8_t s) { return gSlotUsers[s] != 0; }
+
+// lowest multitap slot no mounted device uses; devices beyond four share the
+// last one
+uint8_t findFreeSlot() {
+  for (uint8_t s = 0; s != PAD_SLOTS; ++s) {
+    if (!slotUsed(s)) {
+      return s;
+    }
+  }
+  return PAD_SLOTS - 1;
+}
+
+// slot of a new part: the keyboard (or mouse) parts of one device share a
+// slot
+uint8_t devSlot(uint8_t dev_addr, enum EProt prot) {
+  for (uint8_t i = 0; i != CFG_TUH_HID; ++i) {
+    const USBDev *usbdev = findDev(dev_addr, i);
+    if (usbdev && (usbdev->protocols & prot)) {
+      return prot == PROT_MOUSE ? usbdev->mouseSlot : usbdev->keybSlot;
+    }
+  }
+  return findFreeSlot();
+}
+
+// enters the entry under (dev_addr, instance), with a slot for each part
+void devClaim(USBDev *usbdev, uint8_t dev_addr, uint8_t instance) {
+  const uint32_t e = usbdev - gUSBDevs;
+  // one after the other, so the parts get slots of their own
+  if (usbdev->protocols & PROT_MOUSE) {
+    usbdev->mouseSlot = devSlot(dev_addr, PROT_MOUSE);
+    ++gSlotUsers[usbdev->mouseSlot];
+  }
+  if (usbdev->protocols & PROT_KEYB) {
+    usbdev->keybSlot = devSlot(dev_addr, PROT_KEYB);
+    ++gSlotUsers[usbdev->keybSlot];
+  }
+  usbdev->dev_addr = dev_addr;
+  usbdev->instance = instance;
+  gDevIndex[dev_addr][instance] = e + 1;
+  gDevUsed |= 1u << e;
+}
+
+// buttons of all keyboard parts on slot s
+uint16_t SRAM_FUNC(slotButtons)(uint8_t s) {
+  uint16_t buttons = 0;
+  for (uint32_t used = gDevUsed; used; used &= used - 1) {
+    const USBDev *usbdev = gUSBDevs + __builtin_ctz(used);
+    if ((usbdev->protocols & PROT_KEYB) && usbdev->keybSlot == s) {
+      buttons |= usbdev->buttons;
+    }
+  }
+  return buttons;
+}
+
+// no poll for this long: the console is loading
+#define PROFILE_POLL_GAP_US 100000
+
+// core1: write what profileChord() changed where nobody notices. A page
+// program stops both cores for about a millisecond, so it goes right after a
+// poll; erasing takes tens of milliseconds and waits for a gap in the polls.
+// USB devices miss their frames meanwhile, but a keyboard is always there.
+// Nothing is written before the first poll, so boot is not held up.
+void profileTask() {
+  static uint32_t writtenPollUs = 0; // one page per poll interval
+  const uint32_t pollUs = gPollUs;
+  const uint32_t sincePoll = time_us_32() - pollUs;
+  const bool pollGap = pollUs != 0 && sincePoll > PROFILE_POLL_GAP_US;
+  if (!gProfileStore.dirty && !pollGap) {
+    return;
+  }
+  if (!pollGap && (sincePoll > 2000 || pollUs == writtenPollUs)) {
+    return;
+  }
+  profileFlush(&gProfileStore, pollGap);
+  writtenPollUs = pollUs;
+}
+
+// core1: slot s now serves a device of protocol prot (PROT_NONE = empty)
+void slotAttach(uint8_t s, enum EProt prot) {
+  InputState *in = gInputs + s;
+  // totals keep running, core0 accounts for motion against them
+  in->buttons = 0;
+  in->l = false;
+  in->r = false;
+  in->prot = prot;
+  if (prot != PROT_NONE) {
+    gActiveSlot = s;
+  }
+  gInputDirty = true;
+}
+
+// core1: a part on slot s went away
+void slotDetach(uint8_t s) {
+  if (!slotUsed(s)) {
+    slotAttach(s, PROT_NONE);
+  } else if (gInputs[s].prot == PROT_KEYB) {
+    // keys held on the keyboard that went away
+    gInputs[s].buttons = slotButtons(s);
+    gInputDirty = true;
+  }
+}
+
+// core1: until something is mounted, slot 0 answers as the last device did
+void deviceExpect() {
+  const DeviceCache *d = &gProfileStore.device;
+  if (gProfileStore.hasDevice &&
+      (d->protocol == PROT_MOUSE || d->protocol == PROT_KEYB)) {
+    slotAttach(0, d->protocol);
+  }
+}
+
+// core1: the plan of the cached device if d has the same descriptor,
+// otherwise parsed. Returns true for the cached one.
+static bool mouseCompile(MouseConf *conf, const DeviceCache *d,
+                         const uint8_t *descr) {
+  const DeviceCache *c = &gProfileStore.device;
+  if (gProfileStore.hasDevice && c->protocol == PROT_MOUSE &&
+      c->vid == d->vid && c->pid == d->pid && c->descrLen == d->descrLen &&
+      c->descrSum == d->descrSum && mousePlanUnpack(&c->mouse, conf) == 0) {
+    return true;
+  }
+  parseMouseDescr(descr, d->descrLen, conf);
+  return false;
+}
+
+// a mouse part is mounted
+static bool mouseMounted() {
+  for (uint32_t used = gDevUsed; used; used &= used - 1) {
+    if (gUSBDevs[__builtin_ctz(used)].protocols & PROT_MOUSE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// core1: d becomes the last device, written by profileTask() if it changed.
+// A keyboard does not displace the cached mouse while a mouse is mounted,
+// nor the mouse of its own device, whose interfaces may come in any order.
+static void deviceRemember(DeviceCache *d, enum EProt prot,
+                           const MouseConf *mouse) {
+  const DeviceCache *c = &gProfileStore.device;
+  if (prot == PROT_KEYB && gProfileStore.hasDevice &&
+      c->protocol == PROT_MOUSE &&
+      (mouseMounted() || (c->vid == d->vid && c->pid == d->pid))) {
+    return;
+  }
+  d->protocol = prot;
+  if (prot == PROT_MOUSE) {
+    mousePlanPack(mouse, &d->mouse);
+  }
+  profileSaveDevice(&gProfileStore, d);
+}
+
+// core1: the parts of usbdev, each with the reports it reads
+static void devRoutes(USBDev *usbdev) {
+  usbdev->hasIds = 0;
+  memset(usbdev->routes, 0, sizeof(usbdev->routes));
+  if (usbdev->protocols & PROT_MOUSE) {
+    usbdev->hasIds |= usbdev->mouse.hasIds;
+    for (uint32_t id = 0; id != 256; ++id) {
+      if (usbdev->mouse.byId[id] < usbdev->mouse.count) {
+        usbdev->routes[id] |= PROT_MOUSE;
+      }
+    }
+  }
+  if (usbdev->protocols & PROT_KEYB) {
+    usbdev->hasIds |= usbdev->keyb.hasIds;
+    for (uint32_t id = 0; id != 256; ++id) {
+      if (usbdev->keyb.byId[id] < usbdev->keyb.count) {
+        usbdev->routes[id] |= PROT_KEYB;
+      }
+    }
+  }
+}
+
+// core1: a mouse report came in; the mouse is not asked for the next one
+// until pollAlignTask() sees the poll after this one coming
+static void SRAM_FUNC(alignPark)(USBDev *usbdev) {
+  const uint32_t now = time_us_32();
+  // a mouse at rest answers once it moves, which says nothing about its lead
+  if (usbdev->targetUs && usbdev->moved) {
+    if ((int32_t)(now - usbdev->targetUs) > 0) {
+      ++gAlign.late;
+    }
+    // the longest a report took, forgotten slowly
+    const uint32_t took = now - usbdev->armUs;
+    if (took > usbdev->leadUs && took < gAlign.track.periodQ4 >> 4) {
+      usbdev->leadUs = took;
+    } else {
+      usbdev->leadUs -= usbdev->leadUs >> 6;
     }
   }
-  return NULL;
+  gDevParked |= 1u << (usbdev - gUSBDevs);
 }
 
+// core1: follow the polls core0 answers, and ask the parked mice for a report
+// their lead ahead of the next one. Until the polls are regular they are
+// asked right away, as without POLL_ALIGN.
+void pollAlignTask() {
+  const uint32_t start = gPollStartUs;
+  if (start != gAlign.pollStartUs) {
+    gAlign.pollStartUs = start;
+    pollTrackAdd(&gAlign.track, start);
+  }
+  if (!gDevParked) {
+    return;
+  }
+  const uint32_t now = time_us_32();
+  uint32_t next = 0;
+  const bool locked = pollTrackNext(&gAlign.track, now, &next);
+  for (uint32_t parked = gDevParked; parked; parked &= parked - 1) {
+    const uint32_t e = __builtin_ctz(parked);
+    USBDev *usbdev = gUSBDevs + e;
+    if (locked && (usbdev->targetUs == next ||
+                   (int32_t)(now + usbdev->leadUs + ALIGN_MARGIN_US - next) <
+                       0)) {
+      continue; // already reported for this poll, or too early
+    }
+    if (tuh_hid_receive_report(usbdev->dev_addr, usbdev->instance)) {
+      gDevParked &= ~(1u << e);
+      usbdev->armUs = now;
+      usbdev->targetUs = locked ? next : 0;
+    }
+  }
+}
+
+// core1: a mounted interface goes, and its parts off their slots
+static void devUnmount(USBDev *usbdev) {
+  const uint8_t prots = usbdev->protocols;
+  const uint8_t mouseSlot = usbdev->mouseSlot;
+  const uint8_t keybSlot = usbdev->keybSlot;
+  devRelease(usbdev);
+  if (prots & PROT_MOUSE) {
+    slotDetach(mouseSlot);
+  }
+  if (prots & PROT_KEYB) {
+    slotDetach(keybSlot);
+  }
+}
+
+// A boot interface mounted without its report descriptor, which was too big
+// for enumeration, is read with the boot layout once it is in boot protocol.
+// The switch is asked for again while the control endpoint is busy. An
+// interface that stays in report protocol sends reports of its own layout:
+// it is not read until its descriptor is fetched here and it is mounted again
+// with that, and not at all if that fails too.
+#define DESCR_FETCH_MAX 4096
+
+static uint8_t gDescrFetch[DESCR_FETCH_MAX];
+static bool gDescrFetching = false;
+
+static void descrFetched(tuh_xfer_t *xfer) {
+  const uint8_t dev_addr = xfer->user_data >> 8;
+  const uint8_t instance = xfer->user_data & 0xff;
+  gDescrFetching = false;
+  if (xfer->result == XFER_RESULT_SUCCESS && xfer->actual_len != 0 &&
+      xfer->actual_len < DESCR_FETCH_MAX &&
+      tuh_hid_mounted(dev_addr, instance)) {
+    tuh_hid_mount_cb(dev_addr, instance, gDescrFetch, xfer->actual_len);
+  }
+}
+
+// core1: the interface stayed in report protocol
+static void bootRefused(uint8_t dev_addr, uint8_t instance) {
+  USBDev *usbdev = findDev(dev_addr, instance);
+  if (usbdev) {
+    devUnmount(usbdev);
+  }
+  tuh_itf_info_t info;
+  if (!gDescrFetching && tuh_hid_itf_get_info(dev_addr, instance, &info)) {
+    gDescrFetching = tuh_descriptor_get_hid_report(
+        dev_addr, info.desc.bInterfaceNumber, HID_DESC_TYPE_REPORT, 0,
+        gDescrFetch, sizeof(gDescrFetch), descrFetched,
+        (uintptr_t)dev_addr << 8 | instance);
+  }
+}
+
+// core1: ask the boot interfaces again to switch to boot protocol
+void bootTask() {
+  for (uint32_t boot = gDevBoot; boot; boot &= boot - 1) {
+    const uint32_t e = __builtin_ctz(boot);
+    const USBDev *usbdev = gUSBDevs + e;
+    if (tuh_hid_set_protocol(usbdev->dev_addr, usbdev->instance,
+                             HID_PROTOCOL_BOOT)) {
+      gDevBoot &= ~(1u << e);
+    }
+  }
+}
+
+// Boot protocol reports as laid out by the HID 1.11 boot descriptors
+// (appendix B), the output report of the keyboard left out
+static const uint8_t BOOT_MOUSE_DESCR[] = {
+    0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x09, 0x01, 0xa1, 0x00, 0x05,
+    0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03,
+    0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05, 0x81, 0x01, 0x05,
+    0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7f, 0x75, 0x08,
+    0x95, 0x02, 0x81, 0x06, 0xc0, 0xc0};
+
+static const uint8_t BOOT_KEYB_DESCR[] = {
+    0x05, 0x01, 0x09, 0x06, 0xa1, 0x01, 0x05, 0x07, 0x19, 0xe0, 0x29,
+    0xe7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x06, 0x75, 0x08, 0x15,
+    0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+    0xc0};
+
 // Invoked when device with hid interface is mounted
 // Report descriptor is also available for use.
 // tuh_hid_parse_report_descriptor() can be used to parse common/simple enough
@@ -446,153 +1748,247 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance,
   // Interface protocol (hid_interface_protocol_enum_t)
   uint8_t const itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
 
+  // Without its descriptor, a boot interface is switched to the boot
+  // protocol and read as the boot descriptor says; reports are asked for
+  // once that is done, in tuh_hid_set_protocol_complete_cb(), see bootTask()
+  const bool boot =
+      desc_len == 0 && (itf_protocol == HID_ITF_PROTOCOL_MOUSE ||
+                        itf_protocol == HID_ITF_PROTOCOL_KEYBOARD);
+  const uint8_t *descr = desc_report;
+  uint16_t descrLen = desc_len;
+  if (boot && itf_protocol == HID_ITF_PROTOCOL_MOUSE) {
+    descr = BOOT_MOUSE_DESCR;
+    descrLen = sizeof(BOOT_MOUSE_DESCR);
+  } else if (boot) {
+    descr = BOOT_KEYB_DESCR;
+    descrLen = sizeof(BOOT_KEYB_DESCR);
+  }
+
   uint16_t vid, pid;
   tuh_vid_pid_get(dev_addr, &vid, &pid);
 
-#if DEBUG_STDOUT
-  const char *protocol_str[] = {"None", "Keyboard", "Mouse"};
-
-  uint64_t currentTime = to_us_since_boot(get_absolute_time());
-
-  printf("{\"event\":\"mount\",\"timestamp\":\"%llu\",\"vid\":\"%04x\",\"pid\":"
-         "\"%04x\",\"address\":\"%u\",\"instance\":\"%u\",\"protocol\":\"%s\",",
-         currentTime, vid, pid, dev_addr, instance, protocol_str[itf_protocol]);
-
-  printf("\"data\":\"");
+#if DEBUG_TRACE
+  uint8_t traceFlags = 0;
+#endif
 
-  for (int i = 0; i != desc_len; ++i) {
-    if (i != 0)
-      printf(" ");
-    printf("%02x", desc_report[i]);
+  const uint32_t descrStart = time_us_32();
+  DeviceCache dc;
+  memset(&dc, 0, sizeof(dc));
+  dc.version = DEVICE_CACHE_VERSION;
+  dc.vid = vid;
+  dc.pid = pid;
+  dc.descrLen = descrLen;
+  dc.descrSum = deviceDescrSum(descr, descrLen);
+
+  // mounted again without an umount: the old entry goes
+  USBDev *stale = findDev(dev_addr, instance);
+  if (stale) {
+    devRelease(stale);
   }
-  printf("\"");
-#endif
 
-  if (itf_protocol == PROT_KEYB) {
-    USBDev *usbdev = NULL;
-    if (testKeyboardDescr(desc_report, desc_len)) {
-      if ((usbdev = findEmptyDev())) {
-        usbdev->protocol = PROT_KEYB;
-        usbdev->dev_addr = dev_addr;
-        usbdev->instance = instance;
-        mutex_enter_blocking(&mtx);
-        gPixState = PIX_KEYB;
-        gContrProt = PROT_KEYB;
-        mutex_exit(&mtx);
-      }
+  // Compiled straight into a free entry, too big for the stack. Whatever the
+  // interface protocol says, the descriptor decides: receivers put a mouse on
+  // an interface without the mouse protocol, or keys and a mouse on one, and
+  // keyboards have NKRO bitmaps and media keys on interfaces of their own.
+  USBDev *usbdev = devKeyValid(dev_addr, instance) ? findEmptyDev() : NULL;
+  uint8_t prots = PROT_NONE;
+  bool cached = false;
+  if (usbdev) {
+    cached = mouseCompile(&usbdev->mouse, &dc, descr);
+    parseKeybDescr(descr, descrLen, &usbdev->keyb);
+    prots = (usbdev->mouse.count ? PROT_MOUSE : 0) |
+            (usbdev->keyb.count ? PROT_KEYB : 0);
+  }
+  if (prots != PROT_NONE) {
+    usbdev->protocols = prots;
+    devClaim(usbdev, dev_addr, instance);
+    devRoutes(usbdev);
+    memset(usbdev->keys, 0, sizeof(usbdev->keys));
+    usbdev->buttons = 0;
+    usbdev->lastReportUs = 0;
+    usbdev->lastMouseUs = 0;
+    histReset(&usbdev->reportInterval, 9);
+    usbdev->moved = false;
+    usbdev->targetUs = 0;
+    usbdev->leadUs = 0;
+    // the mouse goes last, it is served first
+    if (prots & PROT_KEYB) {
+      slotAttach(usbdev->keybSlot, PROT_KEYB);
     }
-  } else if (itf_protocol == PROT_MOUSE) {
-    USBDev *usbdev = NULL;
-    MouseConf mouseConfTmp;
-    parseMouseDescr(desc_report, desc_len, &mouseConfTmp);
-    if (mouseConfTmp.xI != 255 && mouseConfTmp.yI != 255) {
-      if ((usbdev = findEmptyDev())) {
-        usbdev->protocol = PROT_MOUSE;
-        usbdev->dev_addr = dev_addr;
-        usbdev->instance = instance;
-        usbdev->mouse = mouseConfTmp;
-        mutex_enter_blocking(&mtx);
-        gPixState = PIX_MOUSE;
-        gContrProt = PROT_MOUSE;
-        mutex_exit(&mtx);
-      }
+    if (prots & PROT_MOUSE) {
+      slotAttach(usbdev->mouseSlot, PROT_MOUSE);
     }
+    const enum EProt prot = prots & PROT_MOUSE ? PROT_MOUSE : PROT_KEYB;
+    gPixState = prot == PROT_MOUSE ? PIX_MOUSE : PIX_KEYB;
+    if (!gBoot.mountUs) {
+      gBoot.mountUs = time_us_32();
+      gBoot.descrUs = gBoot.mountUs - descrStart;
+      gBoot.cached = cached;
+    }
+    deviceRemember(&dc, prot, &usbdev->mouse);
+  } else if (usbdev && itf_protocol != PROT_NONE) {
+#if DEBUG_TRACE
+    traceFlags |= TRACE_F_DESCR;
+#endif
   }
 
-  // Receive report from boot keyboard & mouse only
+  // Receive reports from the interfaces we use, and from boot keyboards and
+  // mice in any case so they show up in the trace
   // tuh_hid_report_received_cb() will be invoked when report is available
-  if (itf_protocol == HID_ITF_PROTOCOL_KEYBOARD ||
-      itf_protocol == HID_ITF_PROTOCOL_MOUSE) {
+  if (boot && prots != PROT_NONE) {
+    if (!tuh_hid_set_protocol(dev_addr, instance, HID_PROTOCOL_BOOT)) {
+      gDevBoot |= 1u << (usbdev - gUSBDevs);
+    }
+  } else if (prots != PROT_NONE || itf_protocol == HID_ITF_PROTOCOL_KEYBOARD ||
+             itf_protocol == HID_ITF_PROTOCOL_MOUSE) {
     if (!tuh_hid_receive_report(dev_addr, instance)) {
-#if DEBUG_STDOUT
-      printf(",\"error\":\"cannot request report\"");
+#if DEBUG_TRACE
+      traceFlags |= TRACE_F_NO_REQUEST;
 #endif
     }
   }
-#if DEBUG_STDOUT
-  printf("},\n");
+#if DEBUG_TRACE
+  traceEvent(TRACE_MOUNT, dev_addr, instance, itf_protocol,
+             traceFlags & TRACE_F_NO_REQUEST, vid, pid, desc_report, desc_len);
+  if (traceFlags & TRACE_F_DESCR) {
+    traceEvent(TRACE_PARSE_FAIL, dev_addr, instance, itf_protocol,
+               TRACE_F_DESCR, 0, 0, NULL, 0);
+  }
 #endif
 }
 
+// Invoked when an interface mounted without its descriptor has been asked to
+// switch to boot protocol; protocol is the one it is in now
+void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t instance,
+                                      uint8_t protocol) {
+  if (!findDev(dev_addr, instance)) {
+    return;
+  }
+  if (protocol == HID_PROTOCOL_BOOT) {
+    tuh_hid_receive_report(dev_addr, instance);
+  } else {
+    bootRefused(dev_addr, instance);
+  }
+}
+
 // Invoked when device with hid interface is un-mounted
 void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance) {
-#if DEBUG_STDOUT
-  uint64_t currentTime = to_us_since_boot(get_absolute_time());
-  printf("{\"event\":\"umount\",\"timestamp\":\"%llu\",\"address\":\"%u\","
-         "\"instance\":\"%u\"},\n",
-         currentTime, dev_addr, instance);
+#if DEBUG_TRACE
+  traceEvent(TRACE_UMOUNT, dev_addr, instance, 0, 0, 0, 0, NULL, 0);
 #endif
 
-  USBDev *usbdev = NULL;
-  if ((usbdev = findDev(dev_addr, instance))) {
-    usbdev->protocol = PROT_NONE;
+  USBDev *usbdev = findDev(dev_addr, instance);
+  if (usbdev) {
+    devUnmount(usbdev);
   }
 }
 
 // Invoked when received report from device via interrupt endpoint
-void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance,
-                                uint8_t const *report, uint16_t len) {
-
-#if DEBUG_STDOUT
-  uint64_t currentTime = to_us_since_boot(get_absolute_time());
-
-  printf("{\"event\":\"report\",\"timestamp\":\"%llu\",\"address\":\"%u\","
-         "\"instance\":\"%u\",",
-         currentTime, dev_addr, instance);
-
-  printf("\"data\":\"");
-
-  for (int i = 0; i != len; ++i) {
-    if (i != 0)
-      printf(" ");
-    printf("%02x", report[i]);
+void SRAM_FUNC(tuh_hid_report_received_cb)(uint8_t dev_addr, uint8_t instance,
+                                           uint8_t const *report,
+                                           uint16_t len) {
+
+  USBDev *usbdev = findDev(dev_addr, instance);
+  // continue to request to receive report; mice are asked again in time for
+  // the next poll. A receiver with a keyboard on the same interface is asked
+  // right away, or keys would wait for its mouse to be asked.
+  bool requested = true;
+  if (gPollAlign && usbdev && usbdev->protocols == PROT_MOUSE) {
+    alignPark(usbdev);
+  } else {
+    requested = tuh_hid_receive_report(dev_addr, instance);
   }
-  printf("\"");
+#if DEBUG_TRACE
+  traceEvent(TRACE_REPORT, dev_addr, instance, 0,
+             requested ? 0 : TRACE_F_NO_REQUEST, 0, 0, report, len);
+#else
+  (void)requested;
 #endif
 
-  // continue to request to receive report
-  if (!tuh_hid_receive_report(dev_addr, instance)) {
-#if DEBUG_STDOUT
-    printf(",\"error\":\"cannot request report\"");
-#endif
+  ++gReportStats.received;
+  // the parts the report is for, by its ID
+  uint8_t route = PROT_NONE;
+  if (usbdev) {
+    route = !usbdev->hasIds ? usbdev->routes[0]
+            : len           ? usbdev->routes[report[0]]
+                            : PROT_NONE;
   }
-
-#if DEBUG_STDOUT
-  printf("},\n");
-#endif
-
-  USBDev *usbdev = NULL;
-  if ((usbdev = findDev(dev_addr, instance))) {
-    if (usbdev->protocol == PROT_MOUSE) {
-      int8_t o[4];
+  if (route != PROT_NONE) {
+    const uint32_t now = time_us_32();
+    const uint32_t interval =
+        usbdev->lastReportUs ? now - usbdev->lastReportUs : 0;
+    if (interval) {
+      histAdd(&usbdev->reportInterval, interval);
+    }
+    usbdev->lastReportUs = now;
+    if (route & PROT_MOUSE) {
+      // keyboard reports in between do not count for the speed
+      const uint32_t mouseInterval =
+          usbdev->lastMouseUs ? now - usbdev->lastMouseUs : 0;
+      usbdev->lastMouseUs = now;
+      int16_t o[4];
       if (parseMouseData(report, len, &usbdev->mouse, o) == 0) {
-        mutex_enter_blocking(&mtx);
-        gSumX = sumSat(gSumX, o[1]);
-        gSumY = sumSat(gSumY, o[2]);
-        gL = o[0] & 1;
-        gR = o[0] & 2;
-        gContrProt = PROT_MOUSE;
-        gPixState = gL ? PIX_CLICK : PIX_MOUSE;
-        mutex_exit(&mtx);
+        InputState *in = gInputs + usbdev->mouseSlot;
+        const int16_t d[2] = {o[1], o[2]};
+        int32_t m[2];
+        motionApply(&gMotion, in->motion, d, mouseInterval, m);
+        in->totalX += m[0];
+        in->totalY += m[1];
+        const bool swap = gProfile->flags & PROFILE_SWAP_BUTTONS;
+        const bool l = o[0] & (swap ? 2 : 1);
+        const bool r = o[0] & (swap ? 1 : 2);
+        if (l != in->l || r != in->r) {
+          in->l = l;
+          in->r = r;
+          in->buttons = mouseButtons(in);
+        }
+        in->prot = PROT_MOUSE;
+        usbdev->moved = o[1] || o[2];
+        if (usbdev->moved) {
+          gMouseSlot = usbdev->mouseSlot;
+        }
+        inputUpdated(usbdev->mouseSlot);
+        gPixState = l ? PIX_CLICK : PIX_MOUSE;
+      } else {
+        ++gReportStats.dropped;
+#if DEBUG_TRACE
+        traceEvent(TRACE_PARSE_FAIL, dev_addr, instance, PROT_MOUSE, 0, 0, 0,
+                   NULL, 0);
+#endif
       }
-    } else if (usbdev->protocol == PROT_KEYB) {
-      uint16_t buttons = 0;
-      if (parseKeyboardData(report, len, &buttons)) {
-        mutex_enter_blocking(&mtx);
-        gSumX = 0;
-        gSumY = 0;
-        gButtons = buttons;
-        gContrProt = PROT_KEYB;
+    }
+    if (route & PROT_KEYB) {
+      const uint8_t s = usbdev->keybSlot;
+      if (parseKeybData(report, len, &usbdev->keyb, usbdev->keys) == 0) {
+        KeyBits down;
+        keysDown(usbdev->keys, down);
+        profileChord(down);
+        usbdev->buttons = keyButtons(down);
+        const uint16_t buttons = slotButtons(s);
+        gInputs[s].buttons = buttons;
+        gInputs[s].prot = PROT_KEYB;
+        inputUpdated(s);
         gPixState = buttons & 8 ? PIX_CLICK : PIX_KEYB;
-        mutex_exit(&mtx);
       } else {
-        mutex_enter_blocking(&mtx);
-        gSumX = 0;
-        gSumY = 0;
-        gContrProt = PROT_KEYB;
+        // rollover or a report we cannot read: keep the last good keys
+        gInputs[s].prot = PROT_KEYB;
+        inputUpdated(s);
         gPixState = PIX_OVF;
-        mutex_exit(&mtx);
+        ++gReportStats.dropped;
+#if DEBUG_TRACE
+        traceEvent(TRACE_PARSE_FAIL, dev_addr, instance, PROT_KEYB, 0, 0, 0,
+                   NULL, 0);
+#endif
       }
     }
+  } else {
+    // no device, or a report ID neither part reads
+    ++gReportStats.dropped;
+#if DEBUG_TRACE
+    if (usbdev) {
+      traceEvent(TRACE_PARSE_FAIL, dev_addr, instance, usbdev->protocols, 0, 0,
+                 0, NULL, 0);
+    }
+#endif
   }
 }